@@ -0,0 +1,337 @@
+#!/usr/bin/env python3
+"""Accuracy versus runtime of the delay calculation modes and speed options.
+
+Every deck of the corpus, the examples plus generated RC trees, is run with
+each driver/loader/net mode and each speed option, and compared with the
+reference configuration, CSM driver with varied loader at 1/10 of the default
+time step. Runtime, net simulation steps and the largest delay and transition
+errors are written to a CSV file, and a Pareto table of the configurations
+is printed, sorted by runtime.
+
+With -check, the regression checks are run instead: each check compares
+a configuration with its baseline on every deck, and the script fails if a
+delay or transition differs by more than the relative tolerance of the check.
+With -baseline, the default configurations are also compared with the results
+of the baseline executable, such as a build of an earlier commit. The corpus
+includes examples/xtalk_calc.cir, whose nets are coupled.
+
+Usage: scripts/accuracy_runtime.py [-delay ./delay] [-trees 8] [-seed 1]
+                                   [-repeat 3] [-out harness] [-check]
+                                   [-baseline ./delay.base]
+Run from the repository root, so that the .lib paths of the examples resolve.
+Step counts come from the trace, they are 0 if the Sim trace module is compiled out.
+"""
+
+import argparse
+import csv
+import glob
+import json
+import os
+import random
+import re
+import subprocess
+import sys
+import time
+
+LIB_FILE = "examples/INVx2_ASAP7_75t_R.dat"
+CELL = "INVx2_ASAP7_75t_R"
+
+DRIVER_MODES = ["rampvoltage", "current"]
+LOADER_MODES = ["fixed", "varied"]
+# net=awe is not supported yet
+NET_MODES = ["tran"]
+
+REFERENCE = ("current", "varied", "tran", ["-step-scale=0.1"])
+
+# Speed options of each driver model, [] is the default configuration
+SPEED_OPTIONS = {
+    "rampvoltage": [
+        [],
+        ["-fit=batch"],
+        ["-ceff=pimodel"],
+        ["-integrate=be"],
+        ["-integrate=gear2"],
+        ["-integrate=trbdf2"],
+        ["-integrate=gear2", "-lstable-step-scale=4"],
+        ["-integrate=trbdf2", "-lstable-step-scale=4"],
+        ["-compact"],
+        ["-step-scale=2"],
+        ["-max-iter=10"],
+    ],
+    "current": [
+        [],
+        ["-integrate=trap"],
+        ["-integrate=gear2"],
+        ["-integrate=trbdf2"],
+        ["-integrate=gear2", "-lstable-step-scale=4"],
+        ["-integrate=trbdf2", "-lstable-step-scale=4"],
+        ["-compact"],
+        ["-ccs-tolerance=1e-3"],
+        ["-ccs-tolerance=1e-2"],
+        ["-step-scale=2"],
+        ["-max-iter=10"],
+        ["-refine-top=1"],
+        ["-refine-above=1e99"],
+    ],
+}
+
+# Regression checks, (description, driver, loader, options, baseline options, relative tolerance)
+CHECKS = [
+    ("CSM with gear2 matches the default method", "current", "varied", ["-integrate=gear2"], [], 0.01),
+    # The L-stable methods against trapezoidal, both at the fine step of the reference
+    ("CSM with gear2 matches trapezoidal at the fine step", "current", "varied",
+     ["-integrate=gear2", "-step-scale=0.1"], ["-integrate=trap", "-step-scale=0.1"], 0.005),
+    ("CSM with trbdf2 matches trapezoidal at the fine step", "current", "varied",
+     ["-integrate=trbdf2", "-step-scale=0.1"], ["-integrate=trap", "-step-scale=0.1"], 0.005),
+    ("Ramp driver with gear2 matches trapezoidal at the fine step", "rampvoltage", "fixed",
+     ["-integrate=gear2", "-step-scale=0.1"], ["-integrate=trap", "-step-scale=0.1"], 0.005),
+    ("Ramp driver with trbdf2 matches trapezoidal at the fine step", "rampvoltage", "fixed",
+     ["-integrate=trbdf2", "-step-scale=0.1"], ["-integrate=trap", "-step-scale=0.1"], 0.005),
+    # -check-lut takes table values from NLDMLUT::value and reports lookups of LUTEval
+    # that differ from it, including probes beyond the table edges
+    ("Ramp driver table lookups match NLDMLUT::value", "rampvoltage", "fixed", ["-check-lut"], [], 1e-9),
+    ("CSM table lookups match NLDMLUT::value", "current", "varied", ["-check-lut"], [], 1e-9),
+]
+
+# Configurations whose results must not change against the baseline executable,
+# (driver, loader, options, relative tolerance)
+BASELINE_CHECKS = [
+    ("rampvoltage", "fixed", [], 1e-3),
+    ("current", "varied", [], 1e-3),
+]
+
+DELAY_LINE = re.compile(r"^(Cell|Net) delay of (\S+): ([-+0-9.eE]+), transition on [^:]+: ([-+0-9.eE]+)")
+
+
+def write_tree(path, rng):
+    """RC tree driven by one inverter, with inverters loading some of its nodes"""
+    nodes = ["N0"]
+    lines = [".lib %s" % os.path.abspath(LIB_FILE)]
+    rise = rng.random() < 0.5
+    tran = rng.choice([0.02, 0.05, 0.1, 0.25])
+    lines.append("VVdd POS GND pwl(\n  0 %s\n  %gns %s)" % ("0" if rise else "0.77", tran, "0.77" if rise else "0"))
+    lines.append("Xdriver %s A POS Y N0" % CELL)
+    for i in range(1, rng.randint(3, 12)):
+        parent = rng.choice(nodes)
+        node = "N%d" % i
+        lines.append("R%d %s %s %g" % (i, parent, node, rng.uniform(20, 500)))
+        lines.append("C%d %s GND %gE-15" % (i, node, rng.uniform(0.5, 50)))
+        nodes.append(node)
+    leaves = rng.sample(nodes[1:], rng.randint(1, min(3, len(nodes) - 1)))
+    for k, node in enumerate(leaves):
+        lines.append("Xloader%d %s A %s Y GND" % (k, CELL, node))
+    lines.append("")
+    lines.append(".delay Xdriver/Y")
+    with open(path, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+def corpus(outDir, treeCount, seed):
+    decks = []
+    for path in sorted(glob.glob("examples/*.cir")):
+        with open(path) as f:
+            if ".delay" in f.read():
+                decks.append(path)
+    rng = random.Random(seed)
+    for i in range(treeCount):
+        path = os.path.join(outDir, "tree%d.cir" % i)
+        write_tree(path, rng)
+        decks.append(path)
+    return decks
+
+
+def mode_deck(deck, outDir, driver, loader, net):
+    """Copy of the deck with the given modes, debug output is removed"""
+    with open(deck) as f:
+        lines = [l for l in f.read().splitlines()
+                 if not l.startswith(".option") and not l.startswith(".debug")]
+    lines.append(".option driver=%s loader=%s net=%s" % (driver, loader, net))
+    name = os.path.splitext(os.path.basename(deck))[0]
+    path = os.path.join(outDir, "%s.%s.%s.%s.cir" % (name, driver, loader, net))
+    with open(path, "w") as f:
+        f.write("\n".join(lines) + "\n")
+    return path
+
+
+def run_deck(delay, deck, options, outDir, repeat):
+    """Delays keyed by report line and occurrence, best runtime, step, fallback and
+    -check-lut error counts"""
+    traceFile = os.path.join(outDir, "run.trace")
+    runtime = None
+    output = ""
+    for _ in range(repeat):
+        start = time.perf_counter()
+        proc = subprocess.run([delay] + options + ["-trace=" + traceFile, deck],
+                              stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+        elapsed = time.perf_counter() - start
+        if proc.returncode != 0:
+            return None
+        runtime = elapsed if runtime is None else min(runtime, elapsed)
+        output = proc.stdout
+    delays = {}
+    seen = {}
+    fallbacks = 0
+    lutErrors = 0
+    for line in output.splitlines():
+        lutErrors += line.startswith("ERROR: LUT")
+        match = DELAY_LINE.match(line)
+        if match is None:
+            continue
+        key = (match.group(1), match.group(2))
+        seen[key] = seen.get(key, 0) + 1
+        delays[key + (seen[key],)] = (float(match.group(3)), float(match.group(4)))
+        fallbacks += "[fallback" in line
+    steps = 0
+    exported = subprocess.run([delay, "-trace-export=" + traceFile],
+                              stdout=subprocess.PIPE, universal_newlines=True)
+    if exported.returncode == 0:
+        for event in json.loads(exported.stdout)["traceEvents"]:
+            if event["name"] == "NetSimulation":
+                steps += event["args"]["steps"]
+    return {"delays": delays, "runtime": runtime, "steps": steps, "fallbacks": fallbacks,
+            "lutErrors": lutErrors}
+
+
+def compare(result, reference):
+    """Largest absolute delay and transition errors, and arcs missing in only one of them.
+    Ramp drivers report one calculation, they are compared with the max delays of CSM."""
+    delayErr = 0.0
+    tranErr = 0.0
+    missing = sum(1 for key in reference["delays"] if key[2] == 1 and key not in result["delays"])
+    for key, (delay, tran) in result["delays"].items():
+        if key not in reference["delays"]:
+            missing += 1
+            continue
+        refDelay, refTran = reference["delays"][key]
+        delayErr = max(delayErr, abs(delay - refDelay))
+        tranErr = max(tranErr, abs(tran - refTran))
+    return delayErr, tranErr, missing
+
+
+def relative_error(result, reference):
+    """Largest relative delay or transition difference, inf if an arc is missing in one of them"""
+    if set(result["delays"]) != set(reference["delays"]):
+        return float("inf")
+    err = 0.0
+    for key, values in result["delays"].items():
+        for value, refValue in zip(values, reference["delays"][key]):
+            err = max(err, abs(value - refValue) / max(abs(refValue), 1e-15))
+    return err
+
+
+def check(delay, baselineDelay, decks, outDir):
+    """Runs the regression checks, returns the number of failed checks"""
+    checks = [(name, driver, loader, options, delay, baseOptions, tolerance)
+              for name, driver, loader, options, baseOptions, tolerance in CHECKS]
+    if baselineDelay is not None:
+        for driver, loader, options, tolerance in BASELINE_CHECKS:
+            name = "%s matches %s" % (" ".join([driver, loader] + options), baselineDelay)
+            checks.append((name, driver, loader, options, baselineDelay, options, tolerance))
+    failed = 0
+    for name, driver, loader, options, baseDelay, baseOptions, tolerance in checks:
+        worst = 0.0
+        for deck in decks:
+            modeDeck = mode_deck(deck, outDir, driver, loader, "tran")
+            baseline = run_deck(baseDelay, modeDeck, baseOptions, outDir, 1)
+            result = run_deck(delay, modeDeck, options, outDir, 1)
+            if baseline is None or result is None:
+                worst = float("inf")
+                print("WARNING: %s: run of %s failed" % (name, deck))
+                continue
+            if result["lutErrors"] > 0:
+                worst = float("inf")
+                print("WARNING: %s: %d table lookups differ on %s" % (name, result["lutErrors"], deck))
+                continue
+            worst = max(worst, relative_error(result, baseline))
+        passed = worst <= tolerance
+        failed += not passed
+        print("%s: %s, largest relative difference %.4g, tolerance %g" %
+              ("PASS" if passed else "FAIL", name, worst, tolerance))
+    return failed
+
+
+def pareto(rows):
+    """Rows not dominated in runtime and delay error"""
+    front = []
+    for row in rows:
+        dominated = any(other["runtime"] <= row["runtime"] and other["delayErr"] <= row["delayErr"] and
+                        (other["runtime"] < row["runtime"] or other["delayErr"] < row["delayErr"])
+                        for other in rows)
+        row["pareto"] = not dominated
+        if not dominated:
+            front.append(row)
+    return front
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-delay", default="./delay")
+    parser.add_argument("-trees", type=int, default=8)
+    parser.add_argument("-seed", type=int, default=1)
+    parser.add_argument("-repeat", type=int, default=3)
+    parser.add_argument("-out", default="harness")
+    parser.add_argument("-check", action="store_true", help="run the regression checks")
+    parser.add_argument("-baseline", help="executable whose default results are checked against")
+    args = parser.parse_args()
+    os.makedirs(args.out, exist_ok=True)
+
+    decks = corpus(args.out, args.trees, args.seed)
+    if args.check:
+        sys.exit(1 if check(args.delay, args.baseline, decks, args.out) else 0)
+    refDriver, refLoader, refNet, refOptions = REFERENCE
+    references = {}
+    for deck in decks:
+        refDeck = mode_deck(deck, args.out, refDriver, refLoader, refNet)
+        references[deck] = run_deck(args.delay, refDeck, refOptions, args.out, 1)
+        if references[deck] is None:
+            print("WARNING: Reference run of %s failed, deck is skipped" % deck)
+
+    configs = {}
+    with open(os.path.join(args.out, "runs.csv"), "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["deck", "driver", "loader", "net", "options", "runtime", "steps",
+                         "fallbacks", "delayErr", "tranErr", "missing"])
+        for driver in DRIVER_MODES:
+            for loader in LOADER_MODES:
+                for net in NET_MODES:
+                    for options in SPEED_OPTIONS[driver]:
+                        name = " ".join([driver, loader, net] + options)
+                        config = configs.setdefault(name, {"name": name, "runtime": 0.0, "steps": 0, "fallbacks": 0,
+                                                           "delayErr": 0.0, "tranErr": 0.0, "missing": 0, "failed": 0})
+                        for deck in decks:
+                            reference = references[deck]
+                            if reference is None:
+                                continue
+                            result = run_deck(args.delay, mode_deck(deck, args.out, driver, loader, net),
+                                              options, args.out, args.repeat)
+                            if result is None:
+                                config["failed"] += 1
+                                continue
+                            delayErr, tranErr, missing = compare(result, reference)
+                            writer.writerow([deck, driver, loader, net, " ".join(options), "%.6f" % result["runtime"],
+                                             result["steps"], result["fallbacks"], "%.6g" % delayErr,
+                                             "%.6g" % tranErr, missing])
+                            config["runtime"] += result["runtime"]
+                            config["steps"] += result["steps"]
+                            config["fallbacks"] += result["fallbacks"]
+                            config["delayErr"] = max(config["delayErr"], delayErr)
+                            config["tranErr"] = max(config["tranErr"], tranErr)
+                            config["missing"] += missing
+                        print("%s: %.3fs, delay error %.4g" % (name, config["runtime"], config["delayErr"]),
+                              file=sys.stderr)
+
+    rows = [c for c in configs.values() if c["failed"] == 0]
+    pareto(rows)
+    rows.sort(key=lambda c: c["runtime"])
+    print("| Configuration | Runtime (s) | Steps | Max delay error | Max transition error | Fallbacks | Missing | Pareto |")
+    print("|---|---|---|---|---|---|---|---|")
+    for c in rows:
+        print("| %s | %.3f | %d | %.4g | %.4g | %d | %d | %s |" % (c["name"], c["runtime"], c["steps"], c["delayErr"],
+              c["tranErr"], c["fallbacks"], c["missing"], "*" if c["pareto"] else ""))
+    for c in configs.values():
+        if c["failed"] != 0:
+            print("WARNING: %s failed on %d decks" % (c["name"], c["failed"]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,97 @@
+#include <memory>
+#include "ArcArena.h"
+#include "Debug.h"
+
+namespace NA {
+
+static const size_t initialArenaSize = 1 << 16;
+
+/// Heap memory used after the arena buffer is full
+class ArenaUpstream : public std::pmr::memory_resource {
+  public:
+    size_t allocatedBytes() const { return _allocatedBytes; }
+    void resetCount() { _allocatedBytes = 0; }
+
+  private:
+    void* do_allocate(size_t bytes, size_t alignment) override 
+    {
+      _allocatedBytes += bytes;
+      return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+      std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+      return this == &other;
+    }
+
+  private:
+    size_t _allocatedBytes = 0;
+};
+
+struct ArenaState {
+  std::unique_ptr<char[]>                              _buffer;
+  size_t                                               _bufferSize = 0;
+  ArenaUpstream                                        _upstream;
+  std::unique_ptr<std::pmr::monotonic_buffer_resource> _resource;
+  size_t                                               _depth = 0;
+};
+
+static ArenaState&
+arenaState()
+{
+  static thread_local ArenaState state;
+  return state;
+}
+
+static void
+resizeArena(ArenaState& state, size_t size)
+{
+  state._resource.reset();
+  state._buffer.reset(new char[size]);
+  state._bufferSize = size;
+  state._resource.reset(new std::pmr::monotonic_buffer_resource(state._buffer.get(), size, 
+                                                                &state._upstream));
+}
+
+ArcArena::ArcArena()
+{
+  ArenaState& state = arenaState();
+  if (state._depth == 0 && state._resource == nullptr) {
+    resizeArena(state, initialArenaSize);
+  }
+  ++state._depth;
+}
+
+ArcArena::~ArcArena()
+{
+  ArenaState& state = arenaState();
+  if (--state._depth > 0) {
+    return;
+  }
+  state._resource->release();
+  size_t overflow = state._upstream.allocatedBytes();
+  if (overflow > 0) {
+    state._upstream.resetCount();
+    resizeArena(state, state._bufferSize + overflow);
+    if (Debug::enabled(DebugModule::Sim)) {
+      printf("DEBUG: Arc arena grows to %lu bytes\n", state._bufferSize);
+    }
+  }
+}
+
+std::pmr::memory_resource*
+ArcArena::resource()
+{
+  ArenaState& state = arenaState();
+  if (state._depth == 0) {
+    return std::pmr::get_default_resource();
+  }
+  return state._resource.get();
+}
+
+}
@@ -0,0 +1,33 @@
+#ifndef _NA_ARCARENA_H_
+#define _NA_ARCARENA_H_
+
+#include <vector>
+#include <memory_resource>
+#include "Base.h"
+
+namespace NA {
+
+/// Vector of temporaries allocated from the arena of the current arc
+typedef std::pmr::vector<double> ArenaVector;
+typedef std::pmr::vector<size_t> ArenaIndexVector;
+
+/// Monotonic memory of the temporaries of one arc calculation on this thread.
+/// An ArcArena object opens the arena for the arc, temporaries are allocated
+/// without freeing and all of them are released in bulk when the outermost
+/// ArcArena object is destroyed. The buffer of the arena grows to the peak
+/// usage of the arcs, so later arcs do not allocate from the heap.
+/// Temporaries must not outlive the ArcArena object they are allocated in.
+class ArcArena {
+  public:
+    ArcArena();
+    ~ArcArena();
+    ArcArena(const ArcArena&) = delete;
+    ArcArena& operator=(const ArcArena&) = delete;
+
+    /// Arena of the current arc, or the default resource outside of arcs
+    static std::pmr::memory_resource* resource();
+};
+
+}
+
+#endif
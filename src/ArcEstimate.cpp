@@ -0,0 +1,90 @@
+#include <cmath>
+#include <algorithm>
+#include "ArcEstimate.h"
+#include "Circuit.h"
+#include "CircuitIndex.h"
+#include "Checkpoint.h"
+#include "CSMDriver.h"
+#include "RampVCellDelay.h"
+#include "NetMoments.h"
+#include "RCNet.h"
+
+namespace NA {
+
+ArcEstimate
+estimateArc(const Circuit* ckt, const CellArc* driverArc, bool isMax)
+{
+  ArcEstimate result;
+  size_t vSrcId = driverArc->inputSourceDevId(ckt);
+  if (vSrcId == static_cast<size_t>(-1)) {
+    return result;
+  }
+  bool isRiseOnInputPin = ckt->PWLData(ckt->device(vSrcId)).isRiseTransition();
+  bool isRiseOnDriverPin = (isRiseOnInputPin != driverArc->isInvertedArc());
+  double inputTran = driverArc->inputTransition(ckt);
+  double totalCap = totalConnectedCap(driverArc, ckt, isMax, isRiseOnDriverPin);
+  calcNLDMLUTDelayTrantion(driverArc->nldmData(), inputTran, totalCap, isRiseOnDriverPin, 
+                           result._cellDelay, result._cellTran);
+
+  NetMoments::CapValueFunc capValue = [ckt, isMax, isRiseOnDriverPin](const Device& dev) {
+    if (dev._isInternal == false) {
+      return dev._value;
+    }
+    double cap = isMax ? 0 : 1e99;
+    for (const CellArc* loadArc : CircuitIndex::cellArcsOfDevice(ckt, &dev)) {
+      double loadCap = loadArc->fixedLoadCap(isRiseOnDriverPin);
+      cap = isMax ? std::max(cap, loadCap) : std::min(cap, loadCap);
+    }
+    return cap;
+  };
+  RCNet net(ckt, driverArc->driverSourceId());
+  NetMoments moments(ckt, net, capValue);
+  if (moments.isValid() == false) {
+    return result;
+  }
+  /// The net is rooted at the source behind the driver resistor,
+  /// net delays are measured from the driver output pin
+  moments.setReferenceNode(driverArc->outputNode(ckt));
+  double maxNetDelay = 0;
+  const IndexRange<const Device*>& connDevs = CircuitIndex::tracedDevices(ckt, driverArc->driverSourceId());
+  for (const Device* dev : connDevs) {
+    if (dev->_type != DeviceType::Capacitor || dev->_isInternal == false) {
+      continue;
+    }
+    for (const CellArc* loadArc : CircuitIndex::cellArcsOfDevice(ckt, dev)) {
+      const LibData* libData = loadArc->libData();
+      double lowThres = libData->riseTransitionLowThres();
+      double highThres = libData->riseTransitionHighThres();
+      if (isRiseOnDriverPin == false) {
+        lowThres = 100 - libData->fallTransitionHighThres();
+        highThres = 100 - libData->fallTransitionLowThres();
+      }
+      size_t loadNode = loadArc->inputNode();
+      double netDelay = moments.d2mDelay(loadNode);
+      double stepTran = moments.stepTransition(loadNode, lowThres, highThres);
+      result._loadArcs.push_back(loadArc);
+      result._netDelays.push_back(netDelay);
+      result._loadTrans.push_back(std::sqrt(result._cellTran * result._cellTran + stepTran * stepTran));
+      maxNetDelay = std::max(maxNetDelay, netDelay);
+    }
+  }
+  result._stageDelay = result._cellDelay + maxNetDelay;
+  result._isValid = true;
+  return result;
+}
+
+void
+reportArcEstimate(const CellArc* driverArc, const ArcEstimate& estimate, const char* tag)
+{
+  Checkpoint::report("Cell delay of %s:%s->%s: %G, transition on output pin: %G%s\n", 
+         driverArc->instance().data(), driverArc->fromPin().data(), 
+         driverArc->toPin().data(), estimate._cellDelay, estimate._cellTran, tag);
+  for (size_t i=0; i<estimate._loadArcs.size(); ++i) {
+    const CellArc* loadArc = estimate._loadArcs[i];
+    Checkpoint::report("Net delay of %s->%s: %G, transition on %s: %G%s\n", 
+           driverArc->toPinFullName().data(), loadArc->fromPinFullName().data(), 
+           estimate._netDelays[i], loadArc->fromPinFullName().data(), estimate._loadTrans[i], tag);
+  }
+}
+
+}
@@ -0,0 +1,32 @@
+#ifndef _NA_ARCESTIMATE_H_
+#define _NA_ARCESTIMATE_H_
+
+#include <vector>
+#include "Base.h"
+
+namespace NA {
+
+class Circuit;
+class CellArc;
+
+/// Delays of a driver arc without simulation: NLDM cell delay with 
+/// the lumped load, and D2M delays of the net driven by the driver pin.
+/// Used to screen arcs in tiered mode, and in place of arcs whose
+/// effective cap iterations run out of budget.
+struct ArcEstimate {
+  bool                        _isValid = false;
+  double                      _cellDelay = 0;
+  double                      _cellTran = 0;
+  double                      _stageDelay = 0;
+  std::vector<const CellArc*> _loadArcs;
+  std::vector<double>         _netDelays;
+  std::vector<double>         _loadTrans;
+};
+
+ArcEstimate estimateArc(const Circuit* ckt, const CellArc* driverArc, bool isMax);
+/// Reports the estimation in the format of calculated arcs, tag is appended to each line
+void reportArcEstimate(const CellArc* driverArc, const ArcEstimate& estimate, const char* tag);
+
+}
+
+#endif
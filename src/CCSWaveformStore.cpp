@@ -0,0 +1,186 @@
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <cmath>
+#include "CCSWaveformStore.h"
+#include "LibData.h"
+#include "Debug.h"
+
+namespace NA {
+
+struct EncodedWaveform {
+  double             _startTime = 0;
+  std::vector<float> _timeOffsets;
+  std::vector<float> _values;
+};
+
+typedef std::vector<EncodedWaveform> EncodedGroup;
+typedef std::list<const CCSGroup*> LRUList;
+
+struct CCSWaveformStoreData {
+  /// Groups of the next stage of a path are decoded in another thread
+  std::mutex                                            _mutex;
+  double                                                _tolerance = 0;
+  size_t                                                _capacity = 64;
+  std::unordered_map<const CCSGroup*, EncodedGroup>     _encoded;
+  LRUList                                               _order;
+  std::unordered_map<const CCSGroup*, std::pair<CCSWaveformStore::Waveforms, LRUList::iterator>> _decoded;
+};
+
+static CCSWaveformStoreData&
+storeData()
+{
+  static CCSWaveformStoreData data;
+  return data;
+}
+
+/// Charge of the table current on the output load, integrated with trapezoidal rule
+static Waveform
+calcVoltageWaveform(const CCSLUT& lutData) 
+{
+  Waveform voltages;
+  double cap = lutData.outputLoad();
+  const std::vector<double>& timeSteps = lutData.times();
+  const std::vector<double>& currents = lutData.values();
+  if (timeSteps.empty()) {
+    return voltages;
+  }
+  double voltage = 0;
+  voltages.addPoint(timeSteps[0], 0);
+  for (size_t i=1; i<timeSteps.size(); ++i) {
+    double prevT = timeSteps[i-1];
+    double prevI = currents[i-1];
+    double currentT = timeSteps[i];
+    double currentI = currents[i];
+    double dt = currentT - prevT;
+    double dv = (prevI + currentI) / 2 * dt / cap;
+    voltage += dv;
+    voltages.addPoint(currentT, voltage);
+  }
+  return voltages;
+}
+
+/// True if all points between begin and end are within tolerance
+/// of the line between the two points
+static bool
+fitsLine(const Waveform& waveform, size_t begin, size_t end, double tolerance)
+{
+  const auto& points = waveform.data();
+  double t0 = points[begin]._time;
+  double v0 = points[begin]._value;
+  double slope = (points[end]._value - v0) / (points[end]._time - t0);
+  for (size_t i=begin+1; i<end; ++i) {
+    double v = v0 + slope * (points[i]._time - t0);
+    if (std::abs(v - points[i]._value) > tolerance) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static EncodedWaveform
+encodeWaveform(const Waveform& waveform, double tolerance)
+{
+  EncodedWaveform encoded;
+  const auto& points = waveform.data();
+  if (points.empty()) {
+    return encoded;
+  }
+  encoded._startTime = points[0]._time;
+  std::vector<size_t> knots(1, 0);
+  for (size_t end=2; end<points.size(); ++end) {
+    if (fitsLine(waveform, knots.back(), end, tolerance) == false) {
+      knots.push_back(end - 1);
+    }
+  }
+  if (points.size() > 1) {
+    knots.push_back(points.size() - 1);
+  }
+  encoded._timeOffsets.reserve(knots.size());
+  encoded._values.reserve(knots.size());
+  for (size_t knot : knots) {
+    encoded._timeOffsets.push_back(points[knot]._time - encoded._startTime);
+    encoded._values.push_back(points[knot]._value);
+  }
+  return encoded;
+}
+
+static const EncodedGroup&
+encodedGroup(const CCSGroup& group)
+{
+  CCSWaveformStoreData& data = storeData();
+  const auto& found = data._encoded.find(&group);
+  if (found != data._encoded.end()) {
+    return found->second;
+  }
+  EncodedGroup& encoded = data._encoded[&group];
+  size_t pointCount = 0;
+  size_t knotCount = 0;
+  for (const CCSLUT& lutTable : group.tables()) {
+    const Waveform& voltages = calcVoltageWaveform(lutTable);
+    encoded.push_back(encodeWaveform(voltages, data._tolerance));
+    pointCount += voltages.size();
+    knotCount += encoded.back()._values.size();
+  }
+  if (Debug::enabled(DebugModule::CCS)) {
+    printf("DEBUG: CCS waveforms of %lu tables encoded, %lu of %lu knots kept in %lu bytes\n",
+           encoded.size(), knotCount, pointCount, 
+           encoded.size() * sizeof(EncodedWaveform) + knotCount * 2 * sizeof(float));
+  }
+  return encoded;
+}
+
+CCSWaveformStore::Waveforms
+CCSWaveformStore::voltageWaveforms(const CCSGroup& group)
+{
+  CCSWaveformStoreData& data = storeData();
+  std::lock_guard<std::mutex> lock(data._mutex);
+  const auto& found = data._decoded.find(&group);
+  if (found != data._decoded.end()) {
+    data._order.splice(data._order.begin(), data._order, found->second.second);
+    return found->second.first;
+  }
+  std::shared_ptr<std::vector<Waveform>> waveforms(new std::vector<Waveform>());
+  for (const EncodedWaveform& encoded : encodedGroup(group)) {
+    waveforms->push_back(Waveform());
+    Waveform& waveform = waveforms->back();
+    for (size_t i=0; i<encoded._values.size(); ++i) {
+      waveform.addPoint(encoded._startTime + encoded._timeOffsets[i], encoded._values[i]);
+    }
+  }
+  data._order.push_front(&group);
+  data._decoded[&group] = {waveforms, data._order.begin()};
+  while (data._decoded.size() > data._capacity) {
+    data._decoded.erase(data._order.back());
+    data._order.pop_back();
+  }
+  return waveforms;
+}
+
+void
+CCSWaveformStore::setTolerance(double tolerance)
+{
+  CCSWaveformStoreData& data = storeData();
+  std::lock_guard<std::mutex> lock(data._mutex);
+  data._tolerance = std::max(tolerance, 0.0);
+}
+
+void
+CCSWaveformStore::setCapacity(size_t groupCount)
+{
+  CCSWaveformStoreData& data = storeData();
+  std::lock_guard<std::mutex> lock(data._mutex);
+  data._capacity = std::max(groupCount, static_cast<size_t>(1));
+}
+
+void
+CCSWaveformStore::clear()
+{
+  CCSWaveformStoreData& data = storeData();
+  std::lock_guard<std::mutex> lock(data._mutex);
+  data._encoded.clear();
+  data._decoded.clear();
+  data._order.clear();
+}
+
+}
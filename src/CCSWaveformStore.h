@@ -0,0 +1,37 @@
+#ifndef _NA_CCSWAVESTORE_H_
+#define _NA_CCSWAVESTORE_H_
+
+#include <vector>
+#include <memory>
+#include "Base.h"
+#include "SimResult.h"
+
+namespace NA {
+
+class CCSGroup;
+
+/// Output voltage waveforms of CCS current tables, integrated once per
+/// library group and shared by all CSM drivers of the group.
+/// Waveforms are kept encoded: knots within the tolerance of the line
+/// between their neighbours are dropped, the others are stored as float
+/// time offsets and voltages. Groups are decoded into a small LRU cache,
+/// so the groups of hot arcs are decoded only once. The store can be used
+/// from more than one thread.
+class CCSWaveformStore {
+  public:
+    typedef std::shared_ptr<const std::vector<Waveform>> Waveforms;
+
+    /// Voltage waveforms of all tables of the group, on the output load of each table.
+    /// The returned waveforms stay valid after they are evicted from the cache.
+    static Waveforms voltageWaveforms(const CCSGroup& group);
+    /// Largest voltage error of dropped knots, 0 keeps all knots.
+    /// Groups already encoded are not changed.
+    static void setTolerance(double tolerance);
+    /// Number of decoded groups kept in the cache
+    static void setCapacity(size_t groupCount);
+    static void clear();
+};
+
+}
+
+#endif
@@ -1,7 +1,11 @@
 #include "CSMCellDelay.h"
+#include "CSMDriverCache.h"
+#include "CircuitIndex.h"
+#include "Checkpoint.h"
 #include "CommonUtils.h"
-#include "Simulator.h"
+#include "NetSimulator.h"
 #include "Debug.h"
+#include "Trace.h"
 #include "Plotter.h"
 
 namespace NA {
@@ -36,11 +40,12 @@ CSMCellDelay::initData()
   
   /// init receiver
   size_t drvId = _cellArc->driverSourceId();
-  const std::vector<const Device*>& connDevs = _ckt->traceDevice(drvId);
+  _net = RCNet(_ckt, drvId);
+  const IndexRange<const Device*>& connDevs = CircuitIndex::tracedDevices(_ckt, drvId);
   for (const Device* dev : connDevs) {
     if (dev->_type == DeviceType::Capacitor && dev->_isInternal) {
       _loadCaps.push_back(dev->_devId);
-      const std::vector<CellArc*>& loadArcs = _ckt->cellArcsOfDevice(dev);
+      const IndexRange<const CellArc*>& loadArcs = CircuitIndex::cellArcsOfDevice(_ckt, dev);
       ReceiverVec recvr;
       for (const CellArc* loadArc : loadArcs) {
         recvr.push_back(CSMReceiver(_ckt, loadArc, _isRiseOnDriverPin));
@@ -48,6 +53,12 @@ CSMCellDelay::initData()
       _receiverMap.insert({dev->_devId, recvr});
     }
   }
+  _cacheKey = CSMDriverCache::key(_ckt, _cellArc, _net, _isRiseOnDriverPin, _isMaxDelay);
+  std::vector<double> effCaps;
+  if (Checkpoint::resumeDriverCaps(_driver.inputTransition(), effCaps) ||
+      CSMDriverCache::warmStart(_cacheKey, _driver.inputTransition(), effCaps)) {
+    _driver.setWarmStart(effCaps);
+  }
 }
 
 void
@@ -65,7 +76,7 @@ CSMCellDelay::updateCircuit()
 }
 
 bool
-CSMCellDelay::updateReceiverCap(const SimResult& simResult) const
+CSMCellDelay::updateReceiverCap(const NetSimulator& sim) const
 {
   bool valuesUpdated = false;
   for (size_t capId : _loadCaps) {
@@ -74,7 +85,7 @@ CSMCellDelay::updateReceiverCap(const SimResult& simResult) const
     const ReceiverVec& rcvModels = found->second;
     double cap = _isMaxDelay ? 0 : 1e99;
     for (const CSMReceiver& rcvModel : rcvModels) {
-      double capValue = rcvModel.capValue(simResult);
+      double capValue = rcvModel.capValue(sim);
       if (_isMaxDelay) {
         cap = std::max(cap, capValue);
       } else {
@@ -84,8 +95,9 @@ CSMCellDelay::updateReceiverCap(const SimResult& simResult) const
     Device& capDev = _ckt->device(capId);
     if (capDev._value != cap) {
       capDev._value = cap;
+      trace<TraceModule::CCS>(TraceEvent::ReceiverCap, capId, sim.currentTime(), cap);
       if (Debug::enabled(DebugModule::CCS)) {
-        printf("DEBUG: T@%G Load cap %s value updated to %G\n", simResult.currentTime(), capDev._name.data(), capDev._value);
+        printf("DEBUG: T@%G Load cap %s value updated to %G\n", sim.currentTime(), capDev._name.data(), capDev._value);
       }
       valuesUpdated = true;
     }
@@ -94,7 +106,7 @@ CSMCellDelay::updateReceiverCap(const SimResult& simResult) const
 }
 
 void
-CSMCellDelay::updateReceiverModel(const SimResult& simResult)
+CSMCellDelay::updateReceiverModel(const NetSimResult& simResult)
 {
   for (auto& kv : _receiverMap) {
     ReceiverVec& rcvModels = kv.second;
@@ -109,42 +121,52 @@ CSMCellDelay::calcIteration(bool& converged)
 {
   ++_iterCount;
   if (Debug::enabled(DebugModule::CCS) && _simResult.empty() == false) {
-    PlotData cellArcPlotData;
-    cellArcPlotData._canvasName = "Intermediate calculate result for iteration ";
-    cellArcPlotData._canvasName += std::to_string(_iterCount);
-    populatePlotData(cellArcPlotData, _cellArc->inputNode(), _cellArc->outputNode(_ckt), _ckt);
-    Plotter::plot(cellArcPlotData, {*_ckt}, {_simResult});
-
-    cellArcPlotData._nodeToPlot.clear();
-    cellArcPlotData._nodeSimName.clear();
+    std::string canvasName = "Intermediate calculate result for iteration ";
+    canvasName += std::to_string(_iterCount);
+    plotArcWaveforms(canvasName.data(), _cellArc->inputNode(), _cellArc->outputNode(_ckt), _simResult);
+
+    std::vector<Waveform> loadWaveforms;
     for (size_t loadCapId : _loadCaps) {
       const Device& loadCap = _ckt->device(loadCapId);
-      cellArcPlotData._nodeToPlot.push_back(_ckt->node(loadCap._posNode)._name);
-      cellArcPlotData._nodeSimName.push_back("fd");
+      loadWaveforms.push_back(_simResult.nodeVoltageWaveform(loadCap._posNode));
     }
-    Plotter::plot(cellArcPlotData, {*_ckt}, {_simResult});
+    Plotter::plotWaveforms(loadWaveforms);
   }
 
   converged = updateCircuit();
+  trace<TraceModule::CCS>(TraceEvent::CCSIteration, _iterCount, converged);
   _simResult.clear();
   markSimulationScope();
   AnalysisParameter simParam;
   simParam._name = "fd";
   simParam._type = AnalysisType::Tran;
   simParam._simTime = _driver.inputTransition() * 100;
-  simParam._simTick = _driver.inputTransition() / 100;
+  simParam._simTick = _driver.inputTransition() / 100 * NetSimulator::stepScale(_intMode, _net);
   simParam._intMethod = IntegrateMethod::BackwardEuler;
-  Simulator sim(*_ckt, simParam);
+  NetSimulator sim(*_ckt, _net, simParam);
+  sim.setIntegrateMode(_intMode);
+  sim.setCompactWaveforms(_isCompact);
   setTerminationCondition(_ckt, _cellArc, _isRiseOnDriverPin, sim, _driver.simTerminalVoltage());
+  sim.addStimulus(_cellArc->inputSourceDevId(_ckt));
+  const std::vector<const CellArc*>& arcs = loadArcs();
+  recordArcNodes(_ckt, _cellArc, arcs, _isRiseOnDriverPin, sim);
+  /// Driver and receiver models are updated from these nodes
+  sim.recordNode(_ckt->device(_cellArc->driverSourceId())._posNode);
+  for (size_t loadCapId : _loadCaps) {
+    sim.recordNode(_ckt->device(loadCapId)._posNode);
+  }
+  for (const CellArc* loadArc : arcs) {
+    sim.recordNode(loadArc->inputTranNode());
+  }
   std::function<bool(void)> f = [this, &sim]() {
-    return this->updateReceiverCap(sim.simulationResult());
+    return this->updateReceiverCap(sim);
   };
   sim.setUpdateFunction(f);
   if (Debug::enabled(DebugModule::CCS)) {
     printf("DEBUG: start transient simualtion for CCS calculation\n");
   }
   sim.run();
-  _simResult = sim.simulationResult();
+  _simResult = sim.releaseResult();
   if (Debug::enabled(DebugModule::CCS)) {
     printf("DEBUG: Simulation finished in T@%G, expected %G\n", _simResult.currentTime(), simParam._simTime);
   }
@@ -156,7 +178,21 @@ CSMCellDelay::calculate()
 {
   bool converged = false;
   while (!converged) {
+    if (_budget.isExhausted()) {
+      printf("WARNING: CCS calculation of %s:%s->%s %s after %lu iterations in %G seconds\n", 
+             _cellArc->instance().data(), _cellArc->fromPin().data(), _cellArc->toPin().data(), 
+             _budget.isDiverged() ? "diverged" : "is out of budget", _iterCount, _budget.iterSeconds());
+      return false;
+    }
     calcIteration(converged);
+    _budget.update(_driver.effCaps());
+    _driver.setRelaxation(_budget.relaxation());
+    Checkpoint::saveDriverCaps(_driver.inputTransition(), _driver.effCaps());
+  }
+  CSMDriverCache::store(_cacheKey, _driver.inputTransition(), _driver.effCaps());
+  if (Debug::enabled(DebugModule::CCS)) {
+    printf("DEBUG: CCS calculation of %s:%s->%s converged after %lu iterations\n", 
+           _cellArc->instance().data(), _cellArc->fromPin().data(), _cellArc->toPin().data(), _iterCount);
   }
   return converged;
 }
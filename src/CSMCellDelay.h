@@ -3,9 +3,11 @@
 
 #include "Circuit.h"
 #include "LibData.h"
-#include "SimResult.h"
+#include "RCNet.h"
+#include "NetSimulator.h"
 #include "CSMDriver.h"
 #include "CSMReceiver.h"
+#include "IterationBudget.h"
 
 namespace NA {
 
@@ -16,20 +18,26 @@ class CSMCellDelay {
   public: 
     CSMCellDelay(const CellArc* cellArc, Circuit* ckt, bool isMaxDelay);
 
+    /// Returns false if the iterations run out of budget before they converge,
+    /// result() is then the simulation of the last iteration
     bool calculate();
 
-    SimResult result() const { return _simResult; }
+    const NetSimResult& result() const { return _simResult; }
     bool isRiseOnOutputPin() const { return _isRiseOnDriverPin; }
 
     std::vector<const CellArc*> loadArcs() const;
 
     double inputReferenceTime() const { return _driver.inputReferenceTime(); }
+    void setIntegrateMode(IntegrateMode mode) { _intMode = mode; }
+    void setCompactWaveforms(bool isCompact) { _isCompact = isCompact; }
+    void setBudget(size_t maxIterations, double maxSeconds) { _budget = IterationBudget(maxIterations, maxSeconds); }
+    const IterationBudget& budget() const { return _budget; }
 
   private:
     bool updateCircuit();
     void initData();
-    bool updateReceiverCap(const SimResult& simResult) const;
-    void updateReceiverModel(const SimResult& simResult);
+    bool updateReceiverCap(const NetSimulator& sim) const;
+    void updateReceiverModel(const NetSimResult& simResult);
     void markSimulationScope();
     bool calcIteration(bool& converged);
 
@@ -37,12 +45,18 @@ class CSMCellDelay {
     const CellArc*       _cellArc;
     Circuit*             _ckt;
     const LibData*       _libData;
-    SimResult            _simResult;
+    RCNet                _net;
+    NetSimResult         _simResult;
     bool                 _isRiseOnInputPin = true;
     bool                 _isRiseOnDriverPin = true;
     bool                 _setTerminationCondition = false;
     bool                 _isMaxDelay = true;
+    IntegrateMode        _intMode = IntegrateMode::Default;
+    bool                 _isCompact = false;
     size_t               _iterCount = 0;
+    IterationBudget      _budget;
+    /// Key of the driver solutions in CSMDriverCache
+    size_t               _cacheKey = 0;
     double               _delayThres = 50;
     double               _tranThres1 = 10;
     double               _tranThres2 = 90;
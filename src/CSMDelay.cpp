@@ -1,15 +1,26 @@
 #include "CSMDelay.h"
+#include <cmath>
+#include <algorithm>
+#include <future>
 #include "CSMCellDelay.h"
-#include "Simulator.h"
-#include "SimResult.h"
+#include "CircuitIndex.h"
+#include "ShardRunner.h"
+#include "ArcArena.h"
+#include "Checkpoint.h"
+#include "CCSWaveformStore.h"
+#include "ArcEstimate.h"
+#include "IterationBudget.h"
+#include "NetSimulator.h"
+#include "WaveformCrossing.h"
 #include "Debug.h"
 #include "CommonUtils.h"
 #include "Plotter.h"
 
 namespace NA {
 
-CSMDelay::CSMDelay(const AnalysisParameter& param, const NetlistParser& parser, bool isMaxDelay)
-: _isMaxDelay(isMaxDelay), _ckt(parser, param)
+CSMDelay::CSMDelay(const AnalysisParameter& param, const NetlistParser& parser, 
+                   bool isMaxDelay, const DelayOptions& options)
+: _isMaxDelay(isMaxDelay), _options(options), _ckt(parser, param)
 {
   const std::vector<std::string>& pinsToCalc = parser.cellOutPinsToCalcDelay();
   for (const std::string& outPin : pinsToCalc) {
@@ -23,22 +34,260 @@ CSMDelay::CSMDelay(const AnalysisParameter& param, const NetlistParser& parser,
       _cellArcs.push_back(driverArc);
     }
   }
+  std::vector<size_t> driverDevIds;
+  for (const CellArc* driverArc : _cellArcs) {
+    driverDevIds.push_back(driverArc->driverSourceId());
+    driverDevIds.push_back(driverArc->driverResistorId());
+  }
+  CircuitIndex::build(&_ckt, driverDevIds);
+  if (_options._isPathMode) {
+    /// Stages of a path depend on each other, the first shard calculates the whole path
+    _isInShard.assign(_cellArcs.size(), _options._shardIndex == 0);
+  } else {
+    _isInShard = ShardRunner::shardMask(&_ckt, _cellArcs, _options);
+  }
+  ShardRunner::beginSection(_options);
+  Checkpoint::beginSection();
+}
+
+CSMDelay::~CSMDelay()
+{
+  CircuitIndex::clear(&_ckt);
 }
 
 void
 CSMDelay::calculate()
 {
-  for (const CellArc* driverArc : _cellArcs) {
-    calculateArc(driverArc);
+  if (_options._isPathMode) {
+    calculatePath();
+    return;
+  }
+  if (_options.isTiered()) {
+    calculateTiered();
+    return;
+  }
+  for (size_t i=0; i<_cellArcs.size(); ++i) {
+    if (_isInShard[i]) {
+      ShardRunner::beginArc(_options, i);
+      if (Checkpoint::restoreArc(i, _cellArcs[i])) {
+        continue;
+      }
+      Checkpoint::beginArc(i, _cellArcs[i]);
+      calculateArc(_cellArcs[i]);
+      Checkpoint::endArc();
+    }
+  }
+}
+
+void
+CSMDelay::calculateTiered()
+{
+  /// First tier estimation of each arc
+  std::vector<ArcEstimate> results;
+  std::vector<size_t> order;
+  for (size_t i=0; i<_cellArcs.size(); ++i) {
+    results.push_back(estimateArc(&_ckt, _cellArcs[i], _isMaxDelay));
+    order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(), [&results](size_t a, size_t b) {
+    return results[a]._stageDelay > results[b]._stageDelay;
+  });
+  std::vector<bool> isCritical(_cellArcs.size(), false);
+  for (size_t k=0; k<order.size(); ++k) {
+    size_t i = order[k];
+    isCritical[i] = (results[i]._isValid == false || k < _options._refineTopK || 
+                     (_options._refineThreshold >= 0 && 
+                      results[i]._stageDelay >= _options._refineThreshold));
+  }
+  /// Arcs are ranked among all arcs, each shard only reports its own arcs
+  size_t numCritical = 0;
+  for (size_t i=0; i<_cellArcs.size(); ++i) {
+    if (isCritical[i]) {
+      ++numCritical;
+    }
+    if (_isInShard[i] == false) {
+      continue;
+    }
+    ShardRunner::beginArc(_options, i);
+    if (Checkpoint::restoreArc(i, _cellArcs[i])) {
+      continue;
+    }
+    Checkpoint::beginArc(i, _cellArcs[i]);
+    if (isCritical[i]) {
+      calculateArc(_cellArcs[i]);
+    } else {
+      reportArcEstimate(_cellArcs[i], results[i], " [tier: screen]");
+    }
+    Checkpoint::endArc();
+  }
+  if (_options._shardIndex == 0) {
+    ShardRunner::beginArc(_options, _cellArcs.size());
+    Checkpoint::report("%lu of %lu arcs calculated with CCS, others with NLDM and D2M estimation\n", 
+                       numCritical, _cellArcs.size());
+  }
+}
+
+static size_t invalidId = static_cast<size_t>(-1);
+
+/// Replaces the input stimulus of driverArc with the load pin waveform of the
+/// previous stage, resampled at fractions of the full swing.
+/// Simulated waveforms start from 0 V, the stimulus keeps the voltage levels
+/// and the start time of the stimulus in the deck.
+static bool
+applyStageStimulus(Circuit* ckt, const CellArc* driverArc, 
+                   const Waveform& loadWaveform, double vdd)
+{
+  size_t vSrcId = driverArc->inputSourceDevId(ckt);
+  if (vSrcId == invalidId || loadWaveform.size() < 2) {
+    return false;
   }
+  PWLValue& stimulus = ckt->PWLData(ckt->device(vSrcId));
+  if (stimulus._value.empty()) {
+    return false;
+  }
+  double v0 = stimulus._value.front();
+  double v1 = stimulus._value.back();
+  double w0 = loadWaveform.data().front()._value;
+  bool isRise = loadWaveform.data().back()._value > w0;
+  if ((v1 > v0) != isRise) {
+    return false;
+  }
+  static const double fractions[] = {0.02, 0.05, 0.1, 0.2, 0.3, 0.4, 0.5, 
+                                     0.6, 0.7, 0.8, 0.9, 0.95, 0.98};
+  double swing = isRise ? vdd : -vdd;
+  std::vector<double> thresholds;
+  for (double f : fractions) {
+    thresholds.push_back(w0 + f * swing);
+  }
+  std::vector<double> crossings;
+  measureCrossings(loadWaveform, thresholds, crossings);
+  std::vector<double> fs;
+  std::vector<double> ts;
+  for (size_t i=0; i<crossings.size(); ++i) {
+    double t = crossings[i];
+    if (t == 1e99) {
+      break;
+    }
+    if (ts.empty() || t > ts.back()) {
+      fs.push_back(fractions[i]);
+      ts.push_back(t);
+    }
+  }
+  size_t n = fs.size();
+  if (n < 2) {
+    return false;
+  }
+  /// Simulation stops before the full swing, both ends are extended linearly
+  double startTime = ts[0] - (ts[1] - ts[0]) / (fs[1] - fs[0]) * fs[0];
+  double endTime = ts[n-1] + (ts[n-1] - ts[n-2]) / (fs[n-1] - fs[n-2]) * (1 - fs[n-1]);
+  double t0 = stimulus._time.front();
+  stimulus._time.clear();
+  stimulus._value.clear();
+  stimulus._time.push_back(t0);
+  stimulus._value.push_back(v0);
+  for (size_t i=0; i<n; ++i) {
+    stimulus._time.push_back(t0 + ts[i] - startTime);
+    stimulus._value.push_back(v0 + fs[i] * (v1 - v0));
+  }
+  stimulus._time.push_back(t0 + endTime - startTime);
+  stimulus._value.push_back(v1);
+  return true;
 }
 
+/// Arcs of the .delay pins are the stages of one path in the given order.
+/// The worst load pin waveform of each stage is resampled as the input stimulus
+/// of the next stage. Stages share the circuit and run one after another,
+/// the CCS driver waveforms of the next stage are decoded while the current
+/// stage is calculated.
 void
-CSMDelay::calculateArc(const CellArc* driverArc)
+CSMDelay::calculatePath()
 {
+  double arrival = 0;
+  StageResult prevStage;
+  for (size_t i=0; i<_cellArcs.size(); ++i) {
+    if (_isInShard[i] == false) {
+      continue;
+    }
+    const CellArc* driverArc = _cellArcs[i];
+    if (prevStage._isValid && 
+        applyStageStimulus(&_ckt, driverArc, prevStage._loadWaveform, 
+                           prevStage._loadArc->libData()->voltage()) == false) {
+      printf("ERROR: Cannot drive %s:%s with the waveform on %s, the stimulus in the deck is used\n", 
+             driverArc->instance().data(), driverArc->fromPin().data(), 
+             prevStage._loadArc->fromPinFullName().data());
+    }
+    std::future<void> prefetch;
+    size_t vSrcId = driverArc->inputSourceDevId(&_ckt);
+    if (i + 1 < _cellArcs.size() && vSrcId != invalidId) {
+      bool isRiseOnInputPin = _ckt.PWLData(_ckt.device(vSrcId)).isRiseTransition();
+      bool isRiseOnNextInput = (isRiseOnInputPin != driverArc->isInvertedArc());
+      const CellArc* nextArc = _cellArcs[i+1];
+      LUTType type = (isRiseOnNextInput != nextArc->isInvertedArc()) ? 
+                     LUTType::RiseCurrent : LUTType::FallCurrent;
+      const CCSGroup* nextGroup = &(nextArc->ccsData()->getCurrent(type));
+      prefetch = std::async(std::launch::async, [nextGroup]() {
+        CCSWaveformStore::voltageWaveforms(*nextGroup);
+      });
+    }
+    ShardRunner::beginArc(_options, i);
+    StageResult stage;
+    calculateArc(driverArc, &stage);
+    if (prefetch.valid()) {
+      prefetch.wait();
+    }
+    if (stage._isValid == false) {
+      printf("ERROR: Path stops at %s:%s->%s, no load pin is found\n", driverArc->instance().data(), 
+             driverArc->fromPin().data(), driverArc->toPin().data());
+      break;
+    }
+    arrival += stage._stageDelay;
+    printf("Path arrival at %s: %G\n", stage._loadArc->fromPinFullName().data(), arrival);
+    fflush(stdout);
+    prevStage = std::move(stage);
+  }
+}
+
+/// Arcs out of budget are reported with the NLDM estimation. The last iteration
+/// is still simulated through the whole net, a path goes on with its load pin waveform.
+void
+CSMDelay::reportFallbackArc(const CellArc* driverArc, const NetSimResult& simResult, 
+                            StageResult* stage) const
+{
+  const ArcEstimate& estimate = estimateArc(&_ckt, driverArc, _isMaxDelay);
+  reportArcEstimate(driverArc, estimate, " [fallback: nldm]");
+  if (stage != nullptr && estimate._loadArcs.empty() == false) {
+    size_t worst = 0;
+    for (size_t i=1; i<estimate._netDelays.size(); ++i) {
+      double netDelay = estimate._netDelays[i];
+      if (_isMaxDelay ? netDelay > estimate._netDelays[worst] : netDelay < estimate._netDelays[worst]) {
+        worst = i;
+      }
+    }
+    stage->_isValid = true;
+    stage->_stageDelay = estimate._cellDelay + estimate._netDelays[worst];
+    stage->_loadArc = estimate._loadArcs[worst];
+    stage->_loadWaveform = simResult.nodeVoltageWaveform(stage->_loadArc->inputNode());
+  }
+  fflush(stdout);
+}
+
+void
+CSMDelay::calculateArc(const CellArc* driverArc, StageResult* stage)
+{
+  ArcArena arena;
   CSMCellDelay cellDelayCalc(driverArc, &_ckt, _isMaxDelay);
-  cellDelayCalc.calculate();
-  const SimResult& simResult = cellDelayCalc.result();
+  cellDelayCalc.setIntegrateMode(_options._integrateMode);
+  cellDelayCalc.setCompactWaveforms(_options._compactWaveforms);
+  cellDelayCalc.setBudget(_options._maxIterations, _options._maxArcSeconds);
+  bool converged = cellDelayCalc.calculate();
+  if (_options._reportIterations) {
+    reportArcIterations(driverArc, cellDelayCalc.budget(), converged);
+  }
+  const NetSimResult& simResult = cellDelayCalc.result();
+  if (converged == false) {
+    reportFallbackArc(driverArc, simResult, stage);
+    return;
+  }
   const LibData* libData = driverArc->libData();
   //const Device& inputSrc = _ckt.device(driverArc->inputSourceDevId(&_ckt));
   size_t inputNodeId = driverArc->inputNode();
@@ -50,30 +299,39 @@ CSMDelay::calculateArc(const CellArc* driverArc)
   double outputTran;
   measureVoltage(simResult, outputNodeId, libData, outputT50, outputTran);
   double cellDelay = outputT50 - cellDelayCalc.inputReferenceTime();
-  printf("Cell delay of %s:%s->%s: %G, transition on output pin: %G\n", driverArc->instance().data(), driverArc->fromPin().data(), 
-          driverArc->toPin().data(), cellDelay, outputTran);
+  const char* tier = _options.isTiered() ? " [tier: ccs]" : "";
+  Checkpoint::report("Cell delay of %s:%s->%s: %G, transition on output pin: %G%s\n", driverArc->instance().data(), driverArc->fromPin().data(), 
+          driverArc->toPin().data(), cellDelay, outputTran, tier);
   if (Debug::enabled(DebugModule::CCS)) {
-    PlotData cellArcPlotData;
-    cellArcPlotData._canvasName = "Cell Delay";
-    populatePlotData(cellArcPlotData, driverArc->inputNode(), driverArc->outputNode(&_ckt), &_ckt);
-    Plotter::plot(cellArcPlotData, {_ckt}, {simResult});
+    plotArcWaveforms("Cell Delay", driverArc->inputNode(), driverArc->outputNode(&_ckt), simResult);
   }
   const std::vector<const CellArc*>& loadArcs = cellDelayCalc.loadArcs();
+  const CellArc* worstLoad = nullptr;
+  double worstNetDelay = 0;
   for (const CellArc* loadArc : loadArcs) {
     size_t loadNode = loadArc->inputNode();
     double loadT50;
     double loadTran;
     measureVoltage(simResult, loadNode, loadArc->libData(), loadT50, loadTran);
     double netDelay = loadT50 - outputT50;
-    printf("Net delay of %s->%s: %G, transition on %s: %G\n", driverArc->toPinFullName().data(), 
-           loadArc->fromPinFullName().data(), netDelay, loadArc->fromPinFullName().data(), loadTran);
+    if (worstLoad == nullptr || (_isMaxDelay ? netDelay > worstNetDelay : netDelay < worstNetDelay)) {
+      worstLoad = loadArc;
+      worstNetDelay = netDelay;
+    }
+    Checkpoint::report("Net delay of %s->%s: %G, transition on %s: %G%s\n", driverArc->toPinFullName().data(), 
+           loadArc->fromPinFullName().data(), netDelay, loadArc->fromPinFullName().data(), loadTran, tier);
     if (Debug::enabled(DebugModule::CCS)) {
-      PlotData netArcPlotData;
-      netArcPlotData._canvasName = "Net Delay";
-      populatePlotData(netArcPlotData, driverArc->outputNode(&_ckt), loadArc->inputNode(), &_ckt);
-      Plotter::plot(netArcPlotData, {_ckt}, {simResult});
+      plotArcWaveforms("Net Delay", driverArc->outputNode(&_ckt), loadArc->inputNode(), simResult);
     }
   }
+  if (stage != nullptr && worstLoad != nullptr) {
+    stage->_isValid = true;
+    stage->_stageDelay = cellDelay + worstNetDelay;
+    stage->_loadArc = worstLoad;
+    stage->_loadWaveform = simResult.nodeVoltageWaveform(worstLoad->inputNode());
+  }
+  /// Results are visible as soon as the arc is done when the output is redirected
+  fflush(stdout);
 }
 
 }
\ No newline at end of file
@@ -6,22 +6,45 @@
 #include "Base.h"
 #include "NetlistParser.h"
 #include "Circuit.h"
+#include "SimResult.h"
+#include "DelayOptions.h"
 
 namespace NA {
 
+class NetSimResult;
+
 class CSMDelay {
   public:
-    CSMDelay(const AnalysisParameter& param, const NetlistParser& parser, bool isMaxDelay);
+    CSMDelay(const AnalysisParameter& param, const NetlistParser& parser, 
+             bool isMaxDelay, const DelayOptions& options);
+    ~CSMDelay();
 
     void calculate();
 
   private:
-    void calculateArc(const CellArc* driverArc);
+    /// Result of one stage of a path, see calculatePath
+    struct StageResult {
+      bool           _isValid = false;
+      double         _stageDelay = 0;
+      const CellArc* _loadArc = nullptr;
+      /// Load pin waveform of _loadArc
+      Waveform       _loadWaveform;
+    };
+
+    void calculateTiered();
+    void calculatePath();
+    /// Fills stage with the worst load pin of the arc if it is given
+    void calculateArc(const CellArc* driverArc, StageResult* stage = nullptr);
+    void reportFallbackArc(const CellArc* driverArc, const NetSimResult& simResult, 
+                           StageResult* stage) const;
 
   private:
     bool    _isMaxDelay;
+    DelayOptions _options;
     Circuit _ckt;
     std::vector<const CellArc*> _cellArcs;
+    /// Arcs calculated by this process, see ShardRunner
+    std::vector<bool> _isInShard;
 };
 
 
@@ -0,0 +1,122 @@
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include "CSMDriverCache.h"
+#include "Circuit.h"
+#include "RCNet.h"
+#include "CircuitIndex.h"
+#include "Debug.h"
+
+namespace NA {
+
+typedef std::vector<CSMDriverCache::Solution> Solutions;
+
+static std::unordered_map<size_t, Solutions>&
+cacheData()
+{
+  static std::unordered_map<size_t, Solutions> cache;
+  return cache;
+}
+
+static void
+hashCombine(size_t& hash, size_t value)
+{
+  hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+}
+
+static void
+hashValue(size_t& hash, double value)
+{
+  hashCombine(hash, std::hash<double>()(value));
+}
+
+/// Nodes are hashed by their index in the net instead of the circuit node id,
+/// so that identical nets of different instances have the same hash.
+/// Values of the receiver caps change during calculation,
+/// the library arcs of the receivers are used instead.
+size_t
+CSMDriverCache::key(const Circuit* ckt, const CellArc* driverArc, const RCNet& net,
+                    bool isRise, bool isMax)
+{
+  size_t hash = std::hash<const void*>()(driverArc->ccsData());
+  hashCombine(hash, isRise);
+  hashCombine(hash, isMax);
+  hashCombine(hash, net.size());
+  for (size_t i=0; i<net.size(); ++i) {
+    const RCNet::NetNode& node = net.node(i);
+    hashCombine(hash, i);
+    for (size_t capId : node._caps) {
+      const Device& cap = ckt->device(capId);
+      if (cap._isInternal) {
+        for (const CellArc* loadArc : CircuitIndex::cellArcsOfDevice(ckt, &cap)) {
+          hashCombine(hash, std::hash<const void*>()(loadArc->ccsData()));
+        }
+      } else {
+        hashValue(hash, cap._value);
+      }
+    }
+    for (size_t resId : node._groundRes) {
+      hashValue(hash, ckt->device(resId)._value);
+    }
+  }
+  std::vector<size_t> twoPinDevs = net.resistors();
+  twoPinDevs.insert(twoPinDevs.end(), net.couplingCaps().begin(), net.couplingCaps().end());
+  for (size_t devId : twoPinDevs) {
+    const Device& dev = ckt->device(devId);
+    hashCombine(hash, net.nodeIndex(dev._posNode));
+    hashCombine(hash, net.nodeIndex(dev._negNode));
+    hashValue(hash, dev._value);
+  }
+  return hash;
+}
+
+bool
+CSMDriverCache::warmStart(size_t key, double inputTran, std::vector<double>& effCaps)
+{
+  const auto& found = cacheData().find(key);
+  if (found == cacheData().end() || found->second.empty()) {
+    return false;
+  }
+  const Solutions& solutions = found->second;
+  const auto& upper = std::lower_bound(solutions.begin(), solutions.end(), inputTran,
+                                       [](const Solution& s, double t) { return s._inputTran < t; });
+  if (upper == solutions.begin()) {
+    effCaps = upper->_effCaps;
+  } else if (upper == solutions.end()) {
+    effCaps = solutions.back()._effCaps;
+  } else {
+    const Solution& lower = *(upper - 1);
+    if (lower._effCaps.size() != upper->_effCaps.size()) {
+      effCaps = lower._effCaps;
+    } else {
+      double ratio = (inputTran - lower._inputTran) / (upper->_inputTran - lower._inputTran);
+      effCaps.resize(lower._effCaps.size());
+      for (size_t i=0; i<effCaps.size(); ++i) {
+        effCaps[i] = lower._effCaps[i] + ratio * (upper->_effCaps[i] - lower._effCaps[i]);
+      }
+    }
+  }
+  if (Debug::enabled(DebugModule::CCS)) {
+    printf("DEBUG: Driver effective caps of input transition %G warm started from %lu cached solutions\n",
+           inputTran, solutions.size());
+  }
+  return true;
+}
+
+void
+CSMDriverCache::store(size_t key, double inputTran, const std::vector<double>& effCaps)
+{
+  Solutions& solutions = cacheData()[key];
+  const auto& pos = std::lower_bound(solutions.begin(), solutions.end(), inputTran,
+                                     [](const Solution& s, double t) { return s._inputTran < t; });
+  if (pos != solutions.end() && pos->_inputTran == inputTran) {
+    pos->_effCaps = effCaps;
+    return;
+  }
+  Solution solution;
+  solution._inputTran = inputTran;
+  solution._effCaps = effCaps;
+  solutions.insert(pos, solution);
+}
+
+}
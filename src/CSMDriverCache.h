@@ -0,0 +1,36 @@
+#ifndef _NA_CSMDRVCACHE_H_
+#define _NA_CSMDRVCACHE_H_
+
+#include <vector>
+#include "Base.h"
+
+namespace NA {
+
+class Circuit;
+class CellArc;
+class RCNet;
+
+/// Converged effective caps of CSM drivers, kept per library arc and net,
+/// at each input transition that has been calculated.
+/// Calculations of the same arc driving an identical net at another
+/// input transition start from the solutions interpolated from here.
+class CSMDriverCache {
+  public:
+    struct Solution {
+      double              _inputTran = 0;
+      std::vector<double> _effCaps;
+    };
+
+    /// Arcs of the same library arc and transition direction driving nets with
+    /// the same structure, parasitic values and load arcs share the same key
+    static size_t key(const Circuit* ckt, const CellArc* driverArc, const RCNet& net,
+                      bool isRise, bool isMax);
+    /// Returns false if there is no solution for the key,
+    /// otherwise effCaps is set to the solution interpolated at inputTran
+    static bool warmStart(size_t key, double inputTran, std::vector<double>& effCaps);
+    static void store(size_t key, double inputTran, const std::vector<double>& effCaps);
+};
+
+}
+
+#endif
@@ -0,0 +1,307 @@
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <map>
+#include <unistd.h>
+#include "Checkpoint.h"
+#include "Circuit.h"
+#include "Debug.h"
+
+namespace NA {
+
+static const char checkpointMagic[8] = {'N', 'A', 'C', 'K', 'P', 'T', '1', '\0'};
+
+enum class RecordType : uint32_t {
+  /// Payload: reported output of the finished arc
+  ArcOutput,
+  /// Payload: input transition followed by the effective caps
+  DriverCaps
+};
+
+struct RecordHeader {
+  uint32_t _type;
+  uint32_t _size;
+  uint64_t _section;
+  uint64_t _arcIndex;
+  uint64_t _arcHash;
+};
+
+struct SavedArc {
+  uint64_t            _arcHash = 0;
+  bool                _isFinished = false;
+  std::string         _output;
+  double              _inputTran = 0;
+  std::vector<double> _effCaps;
+};
+
+typedef std::pair<uint64_t, uint64_t> ArcKey;
+
+struct CheckpointState {
+  FILE*                                 _file = nullptr;
+  std::map<ArcKey, SavedArc>            _savedArcs;
+  uint64_t                              _section = 0;
+  bool                                  _inArc = false;
+  uint64_t                              _arcIndex = 0;
+  uint64_t                              _arcHash = 0;
+  std::string                           _output;
+  std::chrono::steady_clock::time_point _lastFlush;
+};
+
+static CheckpointState&
+checkpointState()
+{
+  static CheckpointState state;
+  return state;
+}
+
+/// FNV-1a of the arc names, stable between runs
+static uint64_t
+arcHash(const CellArc* arc)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const std::string& name : {arc->instance(), arc->fromPin(), arc->toPin()}) {
+    for (char c : name) {
+      hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+    hash = (hash ^ '/') * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/// Returns the size of the valid part of the file, a record cut by a crash is dropped
+static long
+loadRecords(FILE* file, CheckpointState& state)
+{
+  char magic[sizeof(checkpointMagic)];
+  if (fread(magic, sizeof(magic), 1, file) != 1 || 
+      memcmp(magic, checkpointMagic, sizeof(magic)) != 0) {
+    return -1;
+  }
+  long validSize = ftell(file);
+  RecordHeader header;
+  std::vector<char> payload;
+  while (fread(&header, sizeof(header), 1, file) == 1) {
+    payload.resize(header._size);
+    if (header._size > 0 && fread(payload.data(), header._size, 1, file) != 1) {
+      break;
+    }
+    validSize = ftell(file);
+    SavedArc& saved = state._savedArcs[ArcKey(header._section, header._arcIndex)];
+    saved._arcHash = header._arcHash;
+    if (header._type == static_cast<uint32_t>(RecordType::ArcOutput)) {
+      saved._isFinished = true;
+      saved._output.assign(payload.data(), payload.size());
+    } else if (header._type == static_cast<uint32_t>(RecordType::DriverCaps) && 
+               payload.size() >= sizeof(double)) {
+      size_t count = payload.size() / sizeof(double);
+      std::vector<double> values(count);
+      memcpy(values.data(), payload.data(), count * sizeof(double));
+      saved._inputTran = values[0];
+      saved._effCaps.assign(values.begin() + 1, values.end());
+    }
+  }
+  return validSize;
+}
+
+bool
+Checkpoint::open(const std::string& fileName, bool resume)
+{
+  CheckpointState& state = checkpointState();
+  close();
+  state._savedArcs.clear();
+  state._section = 0;
+  if (resume) {
+    FILE* file = fopen(fileName.data(), "rb");
+    if (file != nullptr) {
+      long validSize = loadRecords(file, state);
+      fclose(file);
+      if (validSize < 0) {
+        printf("ERROR: %s is not a checkpoint file of this version\n", fileName.data());
+        return false;
+      }
+      if (truncate(fileName.data(), validSize) != 0) {
+        printf("ERROR: Cannot truncate checkpoint file %s\n", fileName.data());
+        return false;
+      }
+      state._file = fopen(fileName.data(), "ab");
+    }
+  }
+  if (state._file == nullptr) {
+    state._file = fopen(fileName.data(), "wb");
+    if (state._file != nullptr) {
+      fwrite(checkpointMagic, sizeof(checkpointMagic), 1, state._file);
+    }
+  }
+  if (state._file == nullptr) {
+    printf("ERROR: Cannot open checkpoint file %s\n", fileName.data());
+    return false;
+  }
+  state._lastFlush = std::chrono::steady_clock::now();
+  if (Debug::enabled(DebugModule::Sim)) {
+    printf("DEBUG: Checkpoint %s opened with %lu saved arcs\n", fileName.data(), state._savedArcs.size());
+  }
+  return true;
+}
+
+void
+Checkpoint::close()
+{
+  CheckpointState& state = checkpointState();
+  if (state._file != nullptr) {
+    fclose(state._file);
+    state._file = nullptr;
+  }
+}
+
+bool
+Checkpoint::isActive()
+{
+  return checkpointState()._file != nullptr;
+}
+
+void
+Checkpoint::beginSection()
+{
+  ++checkpointState()._section;
+}
+
+static void
+writeRecord(RecordType type, const void* payload, size_t size)
+{
+  CheckpointState& state = checkpointState();
+  RecordHeader header;
+  header._type = static_cast<uint32_t>(type);
+  header._size = size;
+  header._section = state._section;
+  header._arcIndex = state._arcIndex;
+  header._arcHash = state._arcHash;
+  fwrite(&header, sizeof(header), 1, state._file);
+  fwrite(payload, size, 1, state._file);
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now - state._lastFlush >= std::chrono::seconds(1)) {
+    fflush(state._file);
+    state._lastFlush = now;
+  }
+}
+
+static const SavedArc*
+savedArc(uint64_t arcIndex, uint64_t hash)
+{
+  CheckpointState& state = checkpointState();
+  const auto& found = state._savedArcs.find(ArcKey(state._section, arcIndex));
+  if (found == state._savedArcs.end() || found->second._arcHash != hash) {
+    return nullptr;
+  }
+  return &(found->second);
+}
+
+bool
+Checkpoint::isFinished(size_t arcIndex, const CellArc* arc)
+{
+  if (isActive() == false) {
+    return false;
+  }
+  const SavedArc* saved = savedArc(arcIndex, arcHash(arc));
+  return saved != nullptr && saved->_isFinished;
+}
+
+bool
+Checkpoint::restoreArc(size_t arcIndex, const CellArc* arc)
+{
+  if (isActive() == false) {
+    return false;
+  }
+  const SavedArc* saved = savedArc(arcIndex, arcHash(arc));
+  if (saved == nullptr || saved->_isFinished == false) {
+    return false;
+  }
+  /// The record stays in the resumed file, it is not written again
+  fwrite(saved->_output.data(), 1, saved->_output.size(), stdout);
+  return true;
+}
+
+void
+Checkpoint::beginArc(size_t arcIndex, const CellArc* arc)
+{
+  CheckpointState& state = checkpointState();
+  if (state._file == nullptr) {
+    return;
+  }
+  state._inArc = true;
+  state._arcIndex = arcIndex;
+  state._arcHash = arcHash(arc);
+  state._output.clear();
+}
+
+void
+Checkpoint::endArc()
+{
+  CheckpointState& state = checkpointState();
+  if (state._inArc == false) {
+    return;
+  }
+  writeRecord(RecordType::ArcOutput, state._output.data(), state._output.size());
+  state._inArc = false;
+}
+
+void
+Checkpoint::report(const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  CheckpointState& state = checkpointState();
+  if (state._inArc) {
+    va_list saveArgs;
+    va_copy(saveArgs, args);
+    char buffer[1024];
+    int size = vsnprintf(buffer, sizeof(buffer), format, saveArgs);
+    va_end(saveArgs);
+    if (size >= static_cast<int>(sizeof(buffer))) {
+      std::vector<char> longBuffer(size + 1);
+      va_copy(saveArgs, args);
+      vsnprintf(longBuffer.data(), longBuffer.size(), format, saveArgs);
+      va_end(saveArgs);
+      state._output.append(longBuffer.data(), size);
+    } else if (size > 0) {
+      state._output.append(buffer, size);
+    }
+  }
+  vprintf(format, args);
+  va_end(args);
+}
+
+void
+Checkpoint::saveDriverCaps(double inputTran, const std::vector<double>& effCaps)
+{
+  CheckpointState& state = checkpointState();
+  if (state._inArc == false || effCaps.empty()) {
+    return;
+  }
+  std::vector<double> values;
+  values.reserve(effCaps.size() + 1);
+  values.push_back(inputTran);
+  values.insert(values.end(), effCaps.begin(), effCaps.end());
+  writeRecord(RecordType::DriverCaps, values.data(), values.size() * sizeof(double));
+}
+
+bool
+Checkpoint::resumeDriverCaps(double inputTran, std::vector<double>& effCaps)
+{
+  CheckpointState& state = checkpointState();
+  if (state._inArc == false) {
+    return false;
+  }
+  const SavedArc* saved = savedArc(state._arcIndex, state._arcHash);
+  if (saved == nullptr || saved->_effCaps.empty() || saved->_inputTran != inputTran) {
+    return false;
+  }
+  effCaps = saved->_effCaps;
+  if (Debug::enabled(DebugModule::CCS)) {
+    printf("DEBUG: Driver effective caps resumed from checkpoint\n");
+  }
+  return true;
+}
+
+}
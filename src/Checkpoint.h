@@ -0,0 +1,47 @@
+#ifndef _NA_CHECKPOINT_H_
+#define _NA_CHECKPOINT_H_
+
+#include <vector>
+#include <string>
+#include "Base.h"
+
+namespace NA {
+
+class CellArc;
+
+/// Append-only file of the results of finished arcs, and of the driver
+/// effective caps of each CSM iteration of the arc being calculated.
+/// A resumed run prints the saved output of finished arcs instead of
+/// calculating them again, and starts the CSM driver of an unfinished arc
+/// from the effective caps of its last saved iteration.
+/// Records are written through a buffer flushed at most once per second.
+/// Arcs are identified by their calculation, index and names, so the deck
+/// must not change between the runs.
+class Checkpoint {
+  public:
+    /// With resume, records of fileName are loaded and new records are appended
+    static bool open(const std::string& fileName, bool resume);
+    static void close();
+    static bool isActive();
+
+    /// Called by each calculation before its arcs
+    static void beginSection();
+    static bool isFinished(size_t arcIndex, const CellArc* arc);
+    /// Returns true if the arc is finished in the loaded checkpoint,
+    /// and prints its saved output
+    static bool restoreArc(size_t arcIndex, const CellArc* arc);
+    /// Results reported between beginArc and endArc are saved with the arc
+    static void beginArc(size_t arcIndex, const CellArc* arc);
+    static void endArc();
+    /// Same as printf, the output is also saved with the current arc
+    static void report(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+    /// Effective caps of the current CSM iteration of the current arc
+    static void saveDriverCaps(double inputTran, const std::vector<double>& effCaps);
+    /// Effective caps saved for the current arc in the loaded checkpoint
+    static bool resumeDriverCaps(double inputTran, std::vector<double>& effCaps);
+};
+
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include <memory>
+#include "CircuitIndex.h"
+#include "Circuit.h"
+#include "Debug.h"
+
+namespace NA {
+
+static std::unordered_map<const Circuit*, std::unique_ptr<CircuitIndex>>&
+indexData()
+{
+  static std::unordered_map<const Circuit*, std::unique_ptr<CircuitIndex>> indices;
+  return indices;
+}
+
+CircuitIndex::CircuitIndex(const Circuit* ckt, const std::vector<size_t>& driverDevIds)
+: _ckt(ckt)
+{
+  _traceOffset.push_back(0);
+  for (size_t devId : driverDevIds) {
+    if (devId == static_cast<size_t>(-1) || _traceSlot.count(devId) > 0) {
+      continue;
+    }
+    const std::vector<const Device*>& connDevs = ckt->traceDevice(devId);
+    _traceSlot.insert({devId, _traceOffset.size() - 1});
+    _tracedDevices.insert(_tracedDevices.end(), connDevs.begin(), connDevs.end());
+    _traceOffset.push_back(_tracedDevices.size());
+  }
+
+  const std::vector<Device>& devices = ckt->devices();
+  _arcOffset.reserve(devices.size() + 1);
+  _arcOffset.push_back(0);
+  for (const Device& dev : devices) {
+    if (dev._isInternal) {
+      const std::vector<CellArc*>& arcs = ckt->cellArcsOfDevice(&dev);
+      _arcs.insert(_arcs.end(), arcs.begin(), arcs.end());
+    }
+    _arcOffset.push_back(_arcs.size());
+  }
+  if (Debug::enabled(DebugModule::Sim)) {
+    printf("DEBUG: Circuit index built with %lu traced drivers, %lu traced devices and %lu cell arcs\n",
+           _traceSlot.size(), _tracedDevices.size(), _arcs.size());
+  }
+}
+
+void
+CircuitIndex::build(const Circuit* ckt, const std::vector<size_t>& driverDevIds)
+{
+  indexData()[ckt].reset(new CircuitIndex(ckt, driverDevIds));
+}
+
+void
+CircuitIndex::clear(const Circuit* ckt)
+{
+  indexData().erase(ckt);
+}
+
+CircuitIndex&
+CircuitIndex::index(const Circuit* ckt)
+{
+  std::unique_ptr<CircuitIndex>& index = indexData()[ckt];
+  if (!index) {
+    index.reset(new CircuitIndex(ckt, std::vector<size_t>()));
+  }
+  return *index;
+}
+
+IndexRange<const Device*>
+CircuitIndex::tracedDevices(const Circuit* ckt, size_t devId)
+{
+  CircuitIndex& idx = index(ckt);
+  const auto& found = idx._traceSlot.find(devId);
+  if (found != idx._traceSlot.end()) {
+    const Device* const* data = idx._tracedDevices.data();
+    return IndexRange<const Device*>(data + idx._traceOffset[found->second],
+                                     data + idx._traceOffset[found->second + 1]);
+  }
+  auto lateFound = idx._lateTraces.find(devId);
+  if (lateFound == idx._lateTraces.end()) {
+    lateFound = idx._lateTraces.insert({devId, ckt->traceDevice(devId)}).first;
+  }
+  const std::vector<const Device*>& connDevs = lateFound->second;
+  return IndexRange<const Device*>(connDevs.data(), connDevs.data() + connDevs.size());
+}
+
+IndexRange<const CellArc*>
+CircuitIndex::cellArcsOfDevice(const Circuit* ckt, const Device* dev)
+{
+  CircuitIndex& idx = index(ckt);
+  size_t devId = dev->_devId;
+  if (devId + 1 >= idx._arcOffset.size()) {
+    return IndexRange<const CellArc*>();
+  }
+  const CellArc* const* data = idx._arcs.data();
+  return IndexRange<const CellArc*>(data + idx._arcOffset[devId],
+                                    data + idx._arcOffset[devId + 1]);
+}
+
+}
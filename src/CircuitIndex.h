@@ -0,0 +1,67 @@
+#ifndef _NA_CKTINDEX_H_
+#define _NA_CKTINDEX_H_
+
+#include <vector>
+#include <unordered_map>
+#include "Base.h"
+
+namespace NA {
+
+class Circuit;
+class CellArc;
+
+/// Read only view of a contiguous range of the index
+template <typename T>
+class IndexRange {
+  public:
+    IndexRange() = default;
+    IndexRange(const T* begin, const T* end) : _begin(begin), _end(end) {}
+
+    const T* begin() const { return _begin; }
+    const T* end() const { return _end; }
+    size_t size() const { return _end - _begin; }
+    bool empty() const { return _begin == _end; }
+    const T& operator[](size_t index) const { return _begin[index]; }
+
+  private:
+    const T* _begin = nullptr;
+    const T* _end = nullptr;
+};
+
+/// Connectivity of an elaborated circuit, built once before delay calculation
+/// so that drivers are not traced again for every use.
+/// Devices traced from each driver device and cell arcs of each device
+/// are stored in CSR form: a flat array and the offsets of each entry.
+/// Devices that are not indexed by build are traced on first use.
+class CircuitIndex {
+  public:
+    /// Replaces the index of ckt, driverDevIds are the devices
+    /// traced with Circuit::traceDevice
+    static void build(const Circuit* ckt, const std::vector<size_t>& driverDevIds);
+    static void clear(const Circuit* ckt);
+
+    /// Same as Circuit::traceDevice
+    static IndexRange<const Device*> tracedDevices(const Circuit* ckt, size_t devId);
+    /// Same as Circuit::cellArcsOfDevice
+    static IndexRange<const CellArc*> cellArcsOfDevice(const Circuit* ckt, const Device* dev);
+
+  private:
+    CircuitIndex(const Circuit* ckt, const std::vector<size_t>& driverDevIds);
+    static CircuitIndex& index(const Circuit* ckt);
+
+  private:
+    const Circuit*                     _ckt = nullptr;
+    /// Slot of each traced driver device in _traceOffset
+    std::unordered_map<size_t, size_t> _traceSlot;
+    std::vector<size_t>                _traceOffset;
+    std::vector<const Device*>         _tracedDevices;
+    /// Offsets of cell arcs by device id
+    std::vector<size_t>                _arcOffset;
+    std::vector<const CellArc*>        _arcs;
+    /// Devices traced after build, kept apart so that ranges stay valid
+    std::unordered_map<size_t, std::vector<const Device*>> _lateTraces;
+};
+
+}
+
+#endif
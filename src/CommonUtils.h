@@ -5,23 +5,25 @@
 #include "CommonUtils.h"
 #include "Circuit.h"
 #include "SimResult.h"
-#include "Simulator.h"
 #include "LibData.h"
 #include "Plotter.h"
+#include "NetSimulator.h"
+#include "WaveformCrossing.h"
+#include "CircuitIndex.h"
 
 namespace NA {
 
 inline std::vector<const CellArc*>
 setTerminationCondition(const Circuit* ckt, const CellArc* driverArc, 
-                        bool isRiseOnDriverPin, Simulator& sim, 
+                        bool isRiseOnDriverPin, NetSimulator& sim, 
                         double driverTermVoltage = std::numeric_limits<double>::quiet_NaN())
 {
   size_t drvId = driverArc->driverSourceId();
-  const std::vector<const Device*>& connDevs = ckt->traceDevice(drvId);
+  const IndexRange<const Device*>& connDevs = CircuitIndex::tracedDevices(ckt, drvId);
   std::vector<const CellArc*> retval;
   for (const Device* dev : connDevs) {
     if (dev->_isInternal && (dev->_type == DeviceType::VoltageSource || dev->_type == DeviceType::Capacitor)) {
-      const std::vector<CellArc*>& loadArcs = ckt->cellArcsOfDevice(dev);
+      const IndexRange<const CellArc*>& loadArcs = CircuitIndex::cellArcsOfDevice(ckt, dev);
       double termVoltage = 0;
       for (const CellArc* cellArc : loadArcs) {
         retval.push_back(cellArc);
@@ -58,11 +60,87 @@ setTerminationCondition(const Circuit* ckt, const CellArc* driverArc,
   return retval;
 }
 
+/// Threshold voltages watched on a transition: delay threshold, 
+/// lower and upper transition thresholds, as passed to Waveform::measure.
+/// Fall thresholds are negative, fall transitions also watch the
+/// transition and delay thresholds shifted by the library voltage,
+/// which are crossed by waveforms that fall from the library voltage.
+inline std::vector<double>
+measureThresholds(const LibData* libData, bool isRise)
+{
+  double libVoltage = libData->voltage();
+  if (isRise) {
+    return {libData->riseDelayThres() / 100 * libVoltage,
+            libData->riseTransitionLowThres() / 100 * libVoltage,
+            libData->riseTransitionHighThres() / 100 * libVoltage};
+  }
+  double delayVoltage = -libData->fallDelayThres() / 100 * libVoltage;
+  double lowerVoltage = (libData->fallTransitionLowThres() - 100) / 100 * libVoltage;
+  double upperVoltage = (libData->fallTransitionHighThres() - 100) / 100 * libVoltage;
+  return {delayVoltage, lowerVoltage, upperVoltage, 
+          libVoltage + lowerVoltage, libVoltage + upperVoltage, libVoltage + delayVoltage};
+}
+
+/// The thresholds measured by measureVoltage are all crossed, so that later
+/// samples cannot change the measurement. Fall transitions are complete once
+/// either the thresholds or the shifted thresholds are all crossed, a waveform
+/// falling from the library voltage never reaches the negative thresholds.
+inline bool
+isMeasureComplete(const CrossingDetector& crossings)
+{
+  if (crossings.isCrossed(0) && crossings.isCrossed(1) && crossings.isCrossed(2)) {
+    return true;
+  }
+  return crossings.thresholds().size() > 5 && crossings.isCrossed(3) && 
+         crossings.isCrossed(4) && crossings.isCrossed(5);
+}
+
+/// Records the nodes measured for the cell arc and its net arcs,
+/// threshold crossings on them are detected during simulation
+inline void
+recordArcNodes(const Circuit* ckt, const CellArc* driverArc, 
+               const std::vector<const CellArc*>& loadArcs, 
+               bool isRiseOnDriverPin, NetSimulator& sim)
+{
+  const LibData* libData = driverArc->libData();
+  bool isRiseOnInputPin = (isRiseOnDriverPin != driverArc->isInvertedArc());
+  sim.watchCrossings(driverArc->inputNode(), measureThresholds(libData, isRiseOnInputPin));
+  sim.watchCrossings(driverArc->outputNode(ckt), measureThresholds(libData, isRiseOnDriverPin));
+  for (const CellArc* loadArc : loadArcs) {
+    sim.watchCrossings(loadArc->inputNode(), 
+                       measureThresholds(loadArc->libData(), isRiseOnDriverPin));
+  }
+}
+
+/// Stops the simulation as soon as the crossings measured on the nodes
+/// watched by recordArcNodes are all found
 inline void
-measureVoltage(const SimResult& result, size_t nodeId, const LibData* libData,  
+terminateAtArcCrossings(const Circuit* ckt, const CellArc* driverArc, 
+                        const std::vector<const CellArc*>& loadArcs, NetSimulator& sim)
+{
+  std::vector<size_t> nodes;
+  nodes.push_back(driverArc->inputNode());
+  nodes.push_back(driverArc->outputNode(ckt));
+  for (const CellArc* loadArc : loadArcs) {
+    nodes.push_back(loadArc->inputNode());
+  }
+  const NetSimulator* simPtr = &sim;
+  sim.setTerminationFunction([nodes, simPtr]() {
+    const NetSimResult& result = simPtr->simulationResult();
+    for (size_t nodeId : nodes) {
+      const CrossingDetector* crossings = result.crossings(nodeId);
+      if (crossings != nullptr && isMeasureComplete(*crossings) == false) {
+        return false;
+      }
+    }
+    return true;
+  });
+}
+
+inline void
+measureVoltage(const Waveform& nodeVoltage, const LibData* libData,  
                double& delay, double& trans)
 {
-  const Waveform& nodeVoltage = result.nodeVoltageWaveform(nodeId);
   bool isRise = nodeVoltage.isRise();
   double delayThres = libData->riseDelayThres();
   double lowerThres = libData->riseTransitionLowThres();
@@ -94,22 +172,31 @@ measureVoltage(const SimResult& result, size_t nodeId, const LibData* libData,
   }
 }
 
+/// Measured with Waveform::measure on the recorded waveform, crossings 
+/// detected during simulation only decide when the simulation can stop
+inline void
+measureVoltage(const NetSimResult& result, size_t nodeId, const LibData* libData,  
+               double& delay, double& trans)
+{
+  measureVoltage(result.nodeVoltageWaveform(nodeId), libData, delay, trans);
+}
+
 inline void
 markSimulationScope(size_t devId, Circuit* ckt)
 {
-  const std::vector<const Device*>& connDevs = ckt->traceDevice(devId);
+  const IndexRange<const Device*>& connDevs = CircuitIndex::tracedDevices(ckt, devId);
   ckt->resetSimulationScope();
-  ckt->markSimulationScope(connDevs);
+  ckt->markSimulationScope(std::vector<const Device*>(connDevs.begin(), connDevs.end()));
 }
 
-inline void 
-populatePlotData(PlotData& plotData, size_t fromNodeId, size_t toNodeId, const Circuit* ckt)
+/// NetSimResult is not known by Plotter, plot the waveforms directly
+inline void
+plotArcWaveforms(const char* canvasName, size_t fromNodeId, size_t toNodeId, 
+                 const NetSimResult& result)
 {
-  const char* simName = "fd";
-  plotData._nodeToPlot.push_back(ckt->node(fromNodeId)._name);
-  plotData._nodeSimName.push_back(simName);
-  plotData._nodeToPlot.push_back(ckt->node(toNodeId)._name);
-  plotData._nodeSimName.push_back(simName);
+  printf("%s:\n", canvasName);
+  Plotter::plotWaveforms({result.nodeVoltageWaveform(fromNodeId), 
+                          result.nodeVoltageWaveform(toNodeId)});
 }
 
 }
@@ -5,30 +5,85 @@
 #include "NetlistParser.h"
 #include "RampVDelay.h"
 #include "CSMDelay.h"
+#include "ShardRunner.h"
+#include "CCSWaveformStore.h"
+#include "LUTEval.h"
+#include "NetSimulator.h"
+#include "Checkpoint.h"
+#include "Trace.h"
 #include "Timer.h"
 #include "StringUtil.h"
 
 namespace NA {
 
+/// With more than one worker, the deck is parsed here
+/// and the analyses are run by the forked workers
 void
-DelayCalculator::run(const char* inFile) 
+DelayCalculator::run(const char* inFile, const DelayOptions& options) 
 {
   NetlistParser parser(inFile);
+  if (options._workers > 1 && options._shardCount <= 1) {
+    const NetlistParser* parserPtr = &parser;
+    ShardRunner::run(options, [parserPtr](const DelayOptions& shardOptions) {
+      runAnalyses(*parserPtr, shardOptions);
+    });
+    return;
+  }
+  runAnalyses(parser, options);
+}
+
+void
+DelayCalculator::runAnalyses(const NetlistParser& parser, const DelayOptions& options) 
+{
+  if (options._traceFile.empty() == false) {
+    std::string traceFile = options._traceFile;
+    if (options._isShardWorker) {
+      traceFile += ".shard" + std::to_string(options._shardIndex);
+    }
+    Trace::start(traceFile);
+  }
+  if (options._checkpointFile.empty() == false) {
+    std::string checkpointFile = options._checkpointFile;
+    if (options._isShardWorker) {
+      checkpointFile += ".shard" + std::to_string(options._shardIndex);
+    }
+    if (Checkpoint::open(checkpointFile, options._resume) == false) {
+      return;
+    }
+  }
+  CCSWaveformStore::setTolerance(options._ccsTolerance);
+  NetSimulator::setStepFactor(options._stepFactor);
+  NetSimulator::setLStableStepFactor(options._lStableStepFactor);
+  setLUTCheck(options._checkLUT);
   const std::vector<AnalysisParameter>& params = parser.analysisParameters();
   for (const AnalysisParameter& param : params) {
     if (param._type == NA::AnalysisType::FD) {
       if (param._driverModel == NA::DriverModel::RampVoltage) {
-        RampVDelay delayCalc(param, parser);
+        RampVDelay delayCalc(param, parser, options);
         delayCalc.calculate();
       }
       if (param._driverModel == NA::DriverModel::PWLCurrent) {
-        CSMDelay delayCalcMax(param, parser, true);
-        delayCalcMax.calculate();
-        CSMDelay delayCalcMin(param, parser, false);
-        delayCalcMin.calculate();
+        if (options._isCrosstalk) {
+          printf("WARNING: Crosstalk delays are only calculated with driver=rampvoltage\n");
+        }
+        /// Each calculation elaborates its own circuit, 
+        /// only one of them is kept in memory at a time
+        {
+          CSMDelay delayCalcMax(param, parser, true, options);
+          delayCalcMax.calculate();
+        }
+        {
+          CSMDelay delayCalcMin(param, parser, false, options);
+          delayCalcMin.calculate();
+        }
       }
     }
   }
+  if (options._checkLUT) {
+    printf("LUT check: %lu lookups differ from NLDMLUT::value\n", lutCheckFailures());
+  }
+  Checkpoint::close();
+  Trace::stop();
 }
 
 }
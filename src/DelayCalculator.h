@@ -1,11 +1,17 @@
 #ifndef _NA_DLYCALC_H_
 #define _NA_DLYCALC_H_
 
+#include "DelayOptions.h"
+#include "NetlistParser.h"
+
 namespace NA {
 
 class DelayCalculator {
   public:
-    static void run(const char* inputFile);
+    static void run(const char* inputFile, const DelayOptions& options);
+
+  private:
+    static void runAnalyses(const NetlistParser& parser, const DelayOptions& options);
 };
 
 
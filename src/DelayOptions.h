@@ -0,0 +1,80 @@
+#ifndef _NA_DLYOPT_H_
+#define _NA_DLYOPT_H_
+
+#include <string>
+
+namespace NA {
+
+enum class EffCapMode : unsigned char {
+  /// Driver charge from transient simulation of the net
+  Transient,
+  /// Driver charge from the pi model of the net, without simulation
+  PiModel
+};
+
+enum class IntegrateMode : unsigned char {
+  /// Backward Euler for CSM drivers, trapezoidal for ramp drivers
+  Default,
+  BackwardEuler,
+  Trapezoidal,
+  /// Second order backward differentiation, L-stable
+  Gear2,
+  /// Trapezoidal stage followed by a Gear2 stage in each step, L-stable
+  TRBDF2
+};
+
+/// Options given on the command line
+struct DelayOptions {
+  EffCapMode _effCapMode = EffCapMode::Transient;
+  /// Fit ramp drivers of all arcs together with RampVFitBatch
+  bool       _batchFit = false;
+  /// Tiered CSM mode, all arcs are screened with NLDM cell delays and
+  /// D2M net delays, only critical arcs are calculated with CSM:
+  /// arcs with stage delay above _refineThreshold, and the _refineTopK
+  /// arcs with the largest stage delays
+  double     _refineThreshold = -1;
+  size_t     _refineTopK = 0;
+  /// Integration method of the net simulations
+  IntegrateMode _integrateMode = IntegrateMode::Default;
+  /// Scale of the time steps of the net simulations, see NetSimulator::stepScale
+  double     _stepFactor = 1;
+  /// Further scale of the time steps of Gear2 and TRBDF2, see NetSimulator::setLStableStepFactor
+  double     _lStableStepFactor = 1;
+  /// Store recorded waveforms of the net simulations as float samples
+  bool       _compactWaveforms = false;
+  /// Arcs of the .delay pins are the stages of one path, see CSMDelay::calculatePath
+  bool       _isPathMode = false;
+  /// Voltage error of the knots dropped from CCS driver waveforms, see CCSWaveformStore
+  double     _ccsTolerance = 0;
+  /// Budgets of the effective cap iterations of each arc, zero is no limit.
+  /// Arcs out of budget are reported with the NLDM estimation, see IterationBudget
+  size_t     _maxIterations = 50;
+  double     _maxArcSeconds = 0;
+  /// Reports the iteration count and time of each arc
+  bool       _reportIterations = false;
+  /// Compares the table lookups of LUTEval with NLDMLUT::value, see setLUTCheck
+  bool       _checkLUT = false;
+  /// Crosstalk delta delays, aggressors are aligned at _crosstalkAlignments offsets
+  /// within _crosstalkWindow of the victim ramp, zero window is the victim transition
+  bool       _isCrosstalk = false;
+  double     _crosstalkWindow = 0;
+  size_t     _crosstalkAlignments = 9;
+  /// Number of worker processes started by the coordinator
+  size_t     _workers = 1;
+  /// Only arcs of shard _shardIndex out of _shardCount shards are calculated
+  size_t     _shardIndex = 0;
+  size_t     _shardCount = 1;
+  /// Set in worker processes, the output of each arc is tagged for the coordinator
+  bool       _isShardWorker = false;
+  /// Binary trace file, see Trace
+  std::string _traceFile;
+  /// Checkpoint file, see Checkpoint. With _resume, arcs finished in the file are skipped
+  std::string _checkpointFile;
+  bool       _resume = false;
+
+  bool isTiered() const { return _refineThreshold >= 0 || _refineTopK > 0; }
+};
+
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include <cmath>
+#include <algorithm>
+#include "IterationBudget.h"
+#include "Circuit.h"
+#include "Checkpoint.h"
+
+namespace NA {
+
+static const double minRelaxation = 0.125;
+static const double minContraction = 0.5;
+
+IterationBudget::IterationBudget(size_t maxIterations, double maxSeconds)
+: _maxIterations(maxIterations), _maxSeconds(maxSeconds), 
+  _startTime(std::chrono::steady_clock::now())
+{
+}
+
+void
+IterationBudget::update(const std::vector<double>& values)
+{
+  ++_iterCount;
+  _iterSeconds = elapsedSeconds();
+  for (double value : values) {
+    if (std::isfinite(value) == false) {
+      _isDiverged = true;
+    }
+  }
+  if (_isDiverged || values.size() != _lastValues.size()) {
+    _lastValues = values;
+    _lastStep.clear();
+    return;
+  }
+  std::vector<double> step(values.size());
+  for (size_t i=0; i<values.size(); ++i) {
+    step[i] = values[i] - _lastValues[i];
+  }
+  if (step.size() == _lastStep.size()) {
+    double product = 0;
+    double stepNorm = 0;
+    double lastStepNorm = 0;
+    for (size_t i=0; i<step.size(); ++i) {
+      product += step[i] * _lastStep[i];
+      stepNorm += step[i] * step[i];
+      lastStepNorm += _lastStep[i] * _lastStep[i];
+    }
+    /// Reversals that shrink fast enough converge without relaxation
+    if (product < 0 && stepNorm > minContraction * minContraction * lastStepNorm) {
+      ++_oscillationCount;
+      _relaxation = std::max(_relaxation * 0.5, minRelaxation);
+    }
+  }
+  _lastValues = values;
+  _lastStep.swap(step);
+}
+
+bool
+IterationBudget::isExhausted() const
+{
+  if (_isDiverged) {
+    return true;
+  }
+  if (_maxIterations > 0 && _iterCount >= _maxIterations) {
+    return true;
+  }
+  return _maxSeconds > 0 && elapsedSeconds() >= _maxSeconds;
+}
+
+double
+IterationBudget::elapsedSeconds() const
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - _startTime).count();
+}
+
+void
+reportArcIterations(const CellArc* driverArc, const IterationBudget& budget, bool converged)
+{
+  Checkpoint::report("Iterations of %s:%s->%s: %lu in %G seconds, %lu oscillations%s\n", 
+                     driverArc->instance().data(), driverArc->fromPin().data(), driverArc->toPin().data(), 
+                     budget.iterCount(), budget.iterSeconds(), budget.oscillationCount(), 
+                     converged ? "" : ", not converged");
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef _NA_ITERBUDGET_H_
+#define _NA_ITERBUDGET_H_
+
+#include <vector>
+#include <chrono>
+#include "Base.h"
+
+namespace NA {
+
+class CellArc;
+
+/// Iteration and time budget of the effective cap iterations of one arc.
+/// Consecutive updates of the iterated values in opposite directions that
+/// do not shrink by half are taken as oscillation, and later updates are
+/// relaxed towards the last values. Values that are not finite end the iterations as divergence.
+class IterationBudget {
+  public:
+    /// Zero is no limit
+    IterationBudget(size_t maxIterations = 0, double maxSeconds = 0);
+
+    /// Records the values of a finished iteration
+    void update(const std::vector<double>& values);
+    /// Next value of an iteration relaxed towards the last value
+    double relax(double last, double next) const { return last + _relaxation * (next - last); }
+
+    bool isExhausted() const;
+    bool isDiverged() const { return _isDiverged; }
+    size_t iterCount() const { return _iterCount; }
+    size_t oscillationCount() const { return _oscillationCount; }
+    double relaxation() const { return _relaxation; }
+    double elapsedSeconds() const;
+    /// Time from the start to the last update
+    double iterSeconds() const { return _iterSeconds; }
+
+  private:
+    size_t              _maxIterations = 0;
+    double              _maxSeconds = 0;
+    std::chrono::steady_clock::time_point _startTime;
+    size_t              _iterCount = 0;
+    double              _iterSeconds = 0;
+    size_t              _oscillationCount = 0;
+    bool                _isDiverged = false;
+    double              _relaxation = 1;
+    std::vector<double> _lastValues;
+    std::vector<double> _lastStep;
+};
+
+/// Reports the iterations of a driver arc in the result output
+void reportArcIterations(const CellArc* driverArc, const IterationBudget& budget, bool converged);
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <unordered_set>
+#include "LUTEval.h"
+#include "LibData.h"
+
+namespace NA {
+
+static bool isLUTCheck = false;
+static size_t numCheckFailures = 0;
+
+/// Index of the grid cell containing x, clamped to the edge cells.
+/// Tables of 7 points are the most common, the search is unrolled for them.
+template <size_t N>
+static inline size_t
+bracketFixed(const double* index, double x)
+{
+  size_t pos = 0;
+  for (size_t i=1; i<N-1; ++i) {
+    pos += (x >= index[i]);
+  }
+  return pos;
+}
+
+static inline size_t
+bracketIndex(const std::vector<double>& index, double x)
+{
+  size_t n = index.size();
+  if (n == 7) {
+    return bracketFixed<7>(index.data(), x);
+  }
+  if (n < 2) {
+    return 0;
+  }
+  size_t pos = std::upper_bound(index.begin() + 1, index.end() - 1, x) - index.begin();
+  return pos - 1;
+}
+
+static inline double
+bracketWeight(const std::vector<double>& index, size_t pos, double x)
+{
+  if (index.size() < 2) {
+    return 0;
+  }
+  return (x - index[pos]) / (index[pos+1] - index[pos]);
+}
+
+LUTBracket
+bracketLUT(const NLDMLUT& lut, double inputTran, double outputLoad)
+{
+  const std::vector<double>& index1 = lut.index1();
+  const std::vector<double>& index2 = lut.index2();
+  LUTBracket bracket;
+  bracket._row = bracketIndex(index1, inputTran);
+  bracket._col = bracketIndex(index2, outputLoad);
+  bracket._rowWeight = bracketWeight(index1, bracket._row, inputTran);
+  bracket._colWeight = bracketWeight(index2, bracket._col, outputLoad);
+  return bracket;
+}
+
+/// Values are stored row by row, index1 selects the row
+double
+interpolateLUT(const NLDMLUT& lut, const LUTBracket& bracket)
+{
+  const std::vector<double>& values = lut.values();
+  size_t cols = lut.index2().size();
+  size_t rowStep = lut.index1().size() > 1 ? cols : 0;
+  size_t colStep = cols > 1 ? 1 : 0;
+  const double* v = values.data() + bracket._row * cols + bracket._col;
+  double q11 = v[0];
+  double q12 = v[colStep];
+  double q21 = v[rowStep];
+  double q22 = v[rowStep + colStep];
+  double q1 = q11 + (q12 - q11) * bracket._colWeight;
+  double q2 = q21 + (q22 - q21) * bracket._colWeight;
+  return q1 + (q2 - q1) * bracket._rowWeight;
+}
+
+static double
+tableScale(const NLDMLUT& lut)
+{
+  double scale = 0;
+  for (double value : lut.values()) {
+    scale = std::max(scale, std::abs(value));
+  }
+  return scale;
+}
+
+/// Compares one lookup with NLDMLUT::value, within 1e-9 of the largest
+/// value of the table
+static bool
+isSameValue(const NLDMLUT& lut, double value, double inputTran, double outputLoad)
+{
+  double lutValue = lut.value(inputTran, outputLoad);
+  if (std::abs(value - lutValue) <= 1e-9 * tableScale(lut)) {
+    return true;
+  }
+  ++numCheckFailures;
+  printf("ERROR: LUT value at (%G, %G) is %G, NLDMLUT::value gives %G\n", 
+         inputTran, outputLoad, value, lutValue);
+  return false;
+}
+
+/// Grid points, midpoints and points half a table span beyond both edges
+static std::vector<double>
+probePoints(const std::vector<double>& index)
+{
+  std::vector<double> points(index);
+  if (index.size() < 2) {
+    return points;
+  }
+  for (size_t i=0; i+1<index.size(); ++i) {
+    points.push_back((index[i] + index[i+1]) / 2);
+  }
+  double span = index.back() - index.front();
+  points.push_back(index.front() - span / 2);
+  points.push_back(index.back() + span / 2);
+  return points;
+}
+
+static void
+probeLUT(const NLDMLUT& lut)
+{
+  std::vector<double> inputTrans = probePoints(lut.index1());
+  std::vector<double> outputLoads = probePoints(lut.index2());
+  for (double inputTran : inputTrans) {
+    for (double outputLoad : outputLoads) {
+      double value = interpolateLUT(lut, bracketLUT(lut, inputTran, outputLoad));
+      isSameValue(lut, value, inputTran, outputLoad);
+    }
+  }
+}
+
+/// value, or NLDMLUT::value after the comparison when the check is on
+static inline double
+checkedValue(const NLDMLUT& lut, double value, double inputTran, double outputLoad)
+{
+  if (isLUTCheck == false) {
+    return value;
+  }
+  static std::unordered_set<const NLDMLUT*> probedLUTs;
+  if (probedLUTs.insert(&lut).second) {
+    probeLUT(lut);
+  }
+  isSameValue(lut, value, inputTran, outputLoad);
+  return lut.value(inputTran, outputLoad);
+}
+
+static inline bool
+hasSameIndex(const NLDMLUT& a, const NLDMLUT& b)
+{
+  if (&(a.index1()) == &(b.index1()) && &(a.index2()) == &(b.index2())) {
+    return true;
+  }
+  return a.index1() == b.index1() && a.index2() == b.index2();
+}
+
+void 
+lutValues(const std::vector<const NLDMLUT*>& luts, double inputTran, 
+          double outputLoad, std::vector<double>& values)
+{
+  values.resize(luts.size());
+  const NLDMLUT* bracketLUTPtr = nullptr;
+  LUTBracket bracket;
+  for (size_t i=0; i<luts.size(); ++i) {
+    const NLDMLUT& lut = *(luts[i]);
+    if (bracketLUTPtr == nullptr || hasSameIndex(*bracketLUTPtr, lut) == false) {
+      bracket = bracketLUT(lut, inputTran, outputLoad);
+      bracketLUTPtr = &lut;
+    }
+    values[i] = checkedValue(lut, interpolateLUT(lut, bracket), inputTran, outputLoad);
+  }
+}
+
+void 
+lutValues(const std::vector<NLDMLUT>& luts, double inputTran, 
+          double outputLoad, std::vector<double>& values)
+{
+  std::vector<const NLDMLUT*> lutPtrs;
+  lutPtrs.reserve(luts.size());
+  for (const NLDMLUT& lut : luts) {
+    lutPtrs.push_back(&lut);
+  }
+  lutValues(lutPtrs, inputTran, outputLoad, values);
+}
+
+void 
+lutValues(const NLDMLUT& lut, const std::vector<double>& inputTrans, 
+          const std::vector<double>& outputLoads, std::vector<double>& values)
+{
+  size_t n = std::min(inputTrans.size(), outputLoads.size());
+  values.resize(n);
+  for (size_t i=0; i<n; ++i) {
+    double value = interpolateLUT(lut, bracketLUT(lut, inputTrans[i], outputLoads[i]));
+    values[i] = checkedValue(lut, value, inputTrans[i], outputLoads[i]);
+  }
+}
+
+void
+setLUTCheck(bool isCheck)
+{
+  isLUTCheck = isCheck;
+}
+
+size_t
+lutCheckFailures()
+{
+  return numCheckFailures;
+}
+
+}
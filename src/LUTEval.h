@@ -0,0 +1,46 @@
+#ifndef _NA_LUTEVAL_H_
+#define _NA_LUTEVAL_H_
+
+#include <vector>
+#include "Base.h"
+
+namespace NA {
+
+class NLDMLUT;
+
+/// Position of a query point in the index grid of NLDM tables,
+/// found once and shared by all tables on the same indices.
+/// Points outside of the table are extrapolated from the edge cells.
+struct LUTBracket {
+  size_t _row = 0;
+  size_t _col = 0;
+  /// Interpolation weights of row+1 and col+1
+  double _rowWeight = 0;
+  double _colWeight = 0;
+};
+
+/// inputTran is looked up in index1 and outputLoad in index2,
+/// the same as NLDMLUT::value(inputTran, outputLoad)
+LUTBracket bracketLUT(const NLDMLUT& lut, double inputTran, double outputLoad);
+double interpolateLUT(const NLDMLUT& lut, const LUTBracket& bracket);
+
+/// Values of many tables at one point. The bracket search is shared
+/// by tables with the same indices.
+void lutValues(const std::vector<const NLDMLUT*>& luts, double inputTran, 
+               double outputLoad, std::vector<double>& values);
+void lutValues(const std::vector<NLDMLUT>& luts, double inputTran, 
+               double outputLoad, std::vector<double>& values);
+/// Values of one table at many points
+void lutValues(const NLDMLUT& lut, const std::vector<double>& inputTrans, 
+               const std::vector<double>& outputLoads, std::vector<double>& values);
+
+/// With the check on, every value above is compared with NLDMLUT::value,
+/// which then gives the result. Each table is also probed once on its
+/// grid, between grid points and beyond its edges. Differences are
+/// printed as errors and counted.
+void setLUTCheck(bool isCheck);
+size_t lutCheckFailures();
+
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include <cmath>
+#include "NetMoments.h"
+#include "RCNet.h"
+#include "Circuit.h"
+
+namespace NA {
+
+NetMoments::NetMoments(const Circuit* ckt, const RCNet& net, const CapValueFunc& capValue)
+: _net(&net)
+{
+  if (net.isTreeTopology() == false) {
+    return;
+  }
+  size_t n = net.size();
+  std::vector<double> cap(n, 0);
+  for (size_t i=0; i<n; ++i) {
+    const RCNet::NetNode& node = net.node(i);
+    if (node._groundRes.empty() == false) {
+      return;
+    }
+    for (size_t capId : node._caps) {
+      const Device& dev = ckt->device(capId);
+      cap[i] += capValue ? capValue(dev) : dev._value;
+    }
+  }
+  std::vector<double> res(n, 0);
+  for (size_t i=1; i<n; ++i) {
+    res[i] = ckt->device(net.node(i)._parentRes)._value;
+  }
+  /// Downstream cap of every node, then m1(i) = m1(parent) + R(i) * Cdown(i).
+  /// m2 follows the same recursion with the caps weighted by m1.
+  const std::vector<size_t>& order = net.order();
+  std::vector<double> down(cap);
+  for (size_t k=order.size()-1; k>0; --k) {
+    size_t i = order[k];
+    down[net.node(i)._parent] += down[i];
+  }
+  _m1.assign(n, 0);
+  for (size_t k=1; k<order.size(); ++k) {
+    size_t i = order[k];
+    _m1[i] = _m1[net.node(i)._parent] + res[i] * down[i];
+  }
+  for (size_t i=0; i<n; ++i) {
+    down[i] = cap[i] * _m1[i];
+  }
+  for (size_t k=order.size()-1; k>0; --k) {
+    size_t i = order[k];
+    down[net.node(i)._parent] += down[i];
+  }
+  _m2.assign(n, 0);
+  for (size_t k=1; k<order.size(); ++k) {
+    size_t i = order[k];
+    _m2[i] = _m2[net.node(i)._parent] + res[i] * down[i];
+  }
+  _isValid = true;
+}
+
+void
+NetMoments::setReferenceNode(size_t nodeId)
+{
+  size_t index = _net->nodeIndex(nodeId);
+  if (index < _m1.size()) {
+    _refIndex = index;
+  }
+}
+
+/// With H(s) = 1 - m1*s + m2*s^2 from the root, the moments from the
+/// reference node b are those of H(s) / Hb(s)
+bool
+NetMoments::relativeMoments(size_t nodeId, double& m1, double& m2) const
+{
+  size_t index = _net->nodeIndex(nodeId);
+  if (index >= _m1.size()) {
+    return false;
+  }
+  double b1 = _m1[_refIndex];
+  m1 = _m1[index] - b1;
+  m2 = _m2[index] - _m2[_refIndex] - b1 * m1;
+  return true;
+}
+
+double
+NetMoments::elmoreDelay(size_t nodeId) const
+{
+  double m1 = 0;
+  double m2 = 0;
+  if (relativeMoments(nodeId, m1, m2) == false) {
+    return 0;
+  }
+  return m1;
+}
+
+double
+NetMoments::d2mDelay(size_t nodeId) const
+{
+  double m1 = 0;
+  double m2 = 0;
+  if (relativeMoments(nodeId, m1, m2) == false || m2 <= 0) {
+    return 0;
+  }
+  return std::log(2.0) * m1 * m1 / std::sqrt(m2);
+}
+
+double
+NetMoments::stepTransition(size_t nodeId, double lowThres, double highThres) const
+{
+  double tau = elmoreDelay(nodeId);
+  return tau * std::log((100 - lowThres) / (100 - highThres));
+}
+
+}
@@ -0,0 +1,51 @@
+#ifndef _NA_NETMOMENTS_H_
+#define _NA_NETMOMENTS_H_
+
+#include <vector>
+#include <functional>
+#include "Base.h"
+
+namespace NA {
+
+class Circuit;
+class RCNet;
+
+/// First two moments of the step responses of an RC tree driven at its root,
+/// m1 is the Elmore delay. Used for fast net delay estimations.
+class NetMoments {
+  public:
+    /// Returns the value used for a grounded capacitor of the net
+    typedef std::function<double(const Device&)> CapValueFunc;
+
+    NetMoments() = default;
+    /// Device values are used for capacitors if capValue is empty.
+    /// Only RC trees without resistors to ground are supported.
+    NetMoments(const Circuit* ckt, const RCNet& net, 
+               const CapValueFunc& capValue = CapValueFunc());
+
+    bool isValid() const { return _isValid; }
+    /// Moments are taken from nodeId instead of the net root, such as the
+    /// output pin of a driver modeled by a source behind a resistor
+    void setReferenceNode(size_t nodeId);
+
+    double elmoreDelay(size_t nodeId) const;
+    /// D2M metric, ln(2) * m1^2 / sqrt(m2)
+    double d2mDelay(size_t nodeId) const;
+    /// Transition from lowThres to highThres percent of a single pole
+    /// response with the Elmore delay as time constant
+    double stepTransition(size_t nodeId, double lowThres, double highThres) const;
+
+  private:
+    bool relativeMoments(size_t nodeId, double& m1, double& m2) const;
+
+  private:
+    bool                _isValid = false;
+    const RCNet*        _net = nullptr;
+    size_t              _refIndex = 0;
+    std::vector<double> _m1;
+    std::vector<double> _m2;
+};
+
+}
+
+#endif
@@ -0,0 +1,1026 @@
+#include <cassert>
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include "NetSimulator.h"
+#include "Circuit.h"
+#include "Simulator.h"
+#include "Debug.h"
+#include "Trace.h"
+
+namespace NA {
+
+static double stepFactor = 1;
+static double lStableStepFactor = 1;
+static const size_t invalidIndex = static_cast<size_t>(-1);
+/// Conductance to ground added to every node of the DC operating point,
+/// so that nodes only coupled to the net through capacitors are still solved
+static const double gmin = 1e-12;
+
+void
+NetSimResult::clear()
+{
+  _currentTime = 0;
+  _stepCount = 0;
+  _sourceCharge.clear();
+  _waveforms.clear();
+  _waveformIndex.clear();
+  _crossings.clear();
+  _crossingIndex.clear();
+  _isCompact = false;
+  _compactError = 0;
+  _times.clear();
+  _samples.clear();
+}
+
+size_t
+NetSimResult::sampleBytes() const
+{
+  if (_isCompact) {
+    size_t bytes = _times.size() * sizeof(double);
+    for (const std::vector<float>& samples : _samples) {
+      bytes += samples.size() * sizeof(float);
+    }
+    return bytes;
+  }
+  size_t bytes = 0;
+  for (const Waveform& waveform : _waveforms) {
+    bytes += waveform.size() * 2 * sizeof(double);
+  }
+  return bytes;
+}
+
+const Waveform&
+NetSimResult::nodeVoltageWaveform(size_t nodeId) const
+{
+  static const Waveform emptyWaveform;
+  const auto& found = _waveformIndex.find(nodeId);
+  if (found == _waveformIndex.end()) {
+    return emptyWaveform;
+  }
+  Waveform& waveform = _waveforms[found->second];
+  if (_isCompact && waveform.size() != _times.size()) {
+    const std::vector<float>& samples = _samples[found->second];
+    waveform.clear();
+    for (size_t i=0; i<_times.size(); ++i) {
+      waveform.addPoint(_times[i], samples[i]);
+    }
+  }
+  return waveform;
+}
+
+bool
+NetSimResult::isRise(size_t nodeId) const
+{
+  if (_isCompact == false) {
+    return nodeVoltageWaveform(nodeId).isRise();
+  }
+  const auto& found = _waveformIndex.find(nodeId);
+  if (found == _waveformIndex.end() || _times.empty()) {
+    return false;
+  }
+  const std::vector<float>& samples = _samples[found->second];
+  return samples.back() > samples.front();
+}
+
+double
+NetSimResult::nodeVoltage(size_t nodeId, double time) const
+{
+  if (_isCompact == false) {
+    return nodeVoltageWaveform(nodeId).value(time);
+  }
+  const auto& found = _waveformIndex.find(nodeId);
+  if (found == _waveformIndex.end() || _times.empty()) {
+    return 0;
+  }
+  const std::vector<float>& samples = _samples[found->second];
+  if (time <= _times.front()) {
+    return samples.front();
+  }
+  if (time >= _times.back()) {
+    return samples.back();
+  }
+  size_t i = std::upper_bound(_times.begin(), _times.end(), time) - _times.begin();
+  double ratio = (time - _times[i-1]) / (_times[i] - _times[i-1]);
+  return samples[i-1] + ratio * (static_cast<double>(samples[i]) - samples[i-1]);
+}
+
+double
+NetSimResult::latestVoltage(size_t nodeId) const
+{
+  if (_isCompact) {
+    const auto& found = _waveformIndex.find(nodeId);
+    if (found == _waveformIndex.end() || _times.empty()) {
+      return 0;
+    }
+    return _samples[found->second].back();
+  }
+  const Waveform& waveform = nodeVoltageWaveform(nodeId);
+  if (waveform.empty()) {
+    return 0;
+  }
+  return waveform.data().back()._value;
+}
+
+double
+NetSimResult::chargeBetween(double timeStart, double timeEnd) const
+{
+  return _sourceCharge.value(timeEnd) - _sourceCharge.value(timeStart);
+}
+
+double
+NetSimResult::totalCharge() const
+{
+  if (_sourceCharge.empty()) {
+    return 0;
+  }
+  return _sourceCharge.data().back()._value;
+}
+
+const CrossingDetector*
+NetSimResult::crossings(size_t nodeId) const
+{
+  const auto& found = _crossingIndex.find(nodeId);
+  if (found == _crossingIndex.end()) {
+    return nullptr;
+  }
+  return &(_crossings[found->second]);
+}
+
+Waveform&
+NetSimResult::addWaveform(size_t nodeId)
+{
+  _waveformIndex.insert({nodeId, _waveforms.size()});
+  _waveforms.push_back(Waveform());
+  _samples.push_back(std::vector<float>());
+  return _waveforms.back();
+}
+
+void
+NetSimResult::addSamples(double time, const ArenaVector& values)
+{
+  if (_isCompact == false) {
+    for (size_t i=0; i<values.size(); ++i) {
+      _waveforms[i].addPoint(time, values[i]);
+    }
+    return;
+  }
+  _times.push_back(time);
+  for (size_t i=0; i<values.size(); ++i) {
+    float sample = static_cast<float>(values[i]);
+    _samples[i].push_back(sample);
+    _compactError = std::max(_compactError, std::abs(sample - values[i]));
+  }
+}
+
+size_t
+SparseLUCache::patternHash(const SparseMatrix& matrix)
+{
+  size_t hash = std::hash<size_t>()(matrix.rows());
+  const int* outer = matrix.outerIndexPtr();
+  const int* inner = matrix.innerIndexPtr();
+  for (Eigen::Index i=0; i<=matrix.outerSize(); ++i) {
+    hash = hash * 31 + outer[i];
+  }
+  for (Eigen::Index i=0; i<matrix.nonZeros(); ++i) {
+    hash = hash * 31 + inner[i];
+  }
+  return hash;
+}
+
+typedef std::list<std::shared_ptr<SparseLUCache::Entry>> LUEntryList;
+
+struct SparseLUCacheData {
+  /// Most recently used first
+  LUEntryList                                                   _entries;
+  std::unordered_map<size_t, std::vector<LUEntryList::iterator>> _index;
+  size_t                                                        _bytes = 0;
+};
+
+static SparseLUCacheData&
+luCacheData()
+{
+  static thread_local SparseLUCacheData data;
+  return data;
+}
+
+static size_t
+entryBytes(const SparseLUCache::Entry& entry)
+{
+  size_t bytes = sizeof(SparseLUCache::Entry);
+  bytes += (entry._outerIndex.size() + entry._innerIndex.size()) * sizeof(int);
+  bytes += entry._values.size() * sizeof(double);
+  if (entry._isFactorized) {
+    bytes += (entry._solver.nnzL() + entry._solver.nnzU()) * (sizeof(double) + sizeof(int));
+  }
+  return bytes;
+}
+
+size_t
+SparseLUCache::bytes()
+{
+  return luCacheData()._bytes;
+}
+
+/// The most recently used entry is kept even if it is larger than the capacity
+void
+SparseLUCache::evict()
+{
+  SparseLUCacheData& data = luCacheData();
+  while (data._bytes > capacity() && data._entries.size() > 1) {
+    LUEntryList::iterator last = std::prev(data._entries.end());
+    const std::shared_ptr<Entry>& e = *last;
+    std::vector<LUEntryList::iterator>& bucket = data._index[e->_hash];
+    bucket.erase(std::find(bucket.begin(), bucket.end(), last));
+    if (bucket.empty()) {
+      data._index.erase(e->_hash);
+    }
+    data._bytes -= e->_bytes;
+    if (Debug::enabled(DebugModule::Sim)) {
+      printf("DEBUG: LU factorization of %lu bytes evicted from the cache\n", e->_bytes);
+    }
+    data._entries.erase(last);
+  }
+}
+
+std::shared_ptr<SparseLUCache::Entry>
+SparseLUCache::entry(const SparseMatrix& matrix)
+{
+  SparseLUCacheData& data = luCacheData();
+  assert(matrix.isCompressed());
+  const int* outer = matrix.outerIndexPtr();
+  const int* inner = matrix.innerIndexPtr();
+  std::vector<int> outerIndex(outer, outer + matrix.outerSize() + 1);
+  std::vector<int> innerIndex(inner, inner + matrix.nonZeros());
+  size_t hash = patternHash(matrix);
+  std::vector<LUEntryList::iterator>& bucket = data._index[hash];
+  for (LUEntryList::iterator& it : bucket) {
+    const std::shared_ptr<Entry>& e = *it;
+    if (e->_outerIndex == outerIndex && e->_innerIndex == innerIndex) {
+      data._entries.splice(data._entries.begin(), data._entries, it);
+      return e;
+    }
+  }
+  std::shared_ptr<Entry> e = std::make_shared<Entry>();
+  e->_hash = hash;
+  e->_outerIndex.swap(outerIndex);
+  e->_innerIndex.swap(innerIndex);
+  e->_solver.analyzePattern(matrix);
+  e->_bytes = entryBytes(*e);
+  data._entries.push_front(e);
+  bucket.push_back(data._entries.begin());
+  data._bytes += e->_bytes;
+  if (Debug::enabled(DebugModule::Sim)) {
+    printf("DEBUG: Symbolic LU factorization created for %ldx%ld matrix with %ld non-zeros\n",
+           matrix.rows(), matrix.cols(), matrix.nonZeros());
+  }
+  evict();
+  return e;
+}
+
+/// Evicted entries are not counted by the cache any more
+bool
+SparseLUCache::factorize(Entry& entry, const SparseMatrix& matrix)
+{
+  const double* values = matrix.valuePtr();
+  if (entry._isFactorized &&
+      std::equal(entry._values.begin(), entry._values.end(), values)) {
+    return true;
+  }
+  entry._solver.factorize(matrix);
+  entry._isFactorized = (entry._solver.info() == Eigen::Success);
+  entry._values.assign(values, values + matrix.nonZeros());
+  if (entry._isFactorized == false) {
+    printf("ERROR: Sparse LU factorization failed: %s\n", entry._solver.lastErrorMessage().data());
+  }
+  size_t bytes = entryBytes(entry);
+  SparseLUCacheData& data = luCacheData();
+  const auto& found = data._index.find(entry._hash);
+  if (found != data._index.end() && 
+      std::any_of(found->second.begin(), found->second.end(), 
+                  [&entry](const LUEntryList::iterator& it) { return it->get() == &entry; })) {
+    data._bytes = data._bytes - entry._bytes + bytes;
+    entry._bytes = bytes;
+    evict();
+  } else {
+    entry._bytes = bytes;
+  }
+  return entry._isFactorized;
+}
+
+static double
+PWLValueAt(const PWLValue& pwl, double time)
+{
+  const std::vector<double>& times = pwl._time;
+  const std::vector<double>& values = pwl._value;
+  if (times.empty()) {
+    return 0;
+  }
+  if (time <= times[0]) {
+    return values[0];
+  }
+  if (time >= times.back()) {
+    return values.back();
+  }
+  size_t i = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+  double t1 = times[i-1];
+  double t2 = times[i];
+  return values[i-1] + (values[i] - values[i-1]) * (time - t1) / (t2 - t1);
+}
+
+NetSimulator::NetSimulator(Circuit& ckt, const RCNet& net, const AnalysisParameter& param)
+: _ckt(&ckt), _net(net), _param(param),
+  _cap(ArcArena::resource()), _gParent(ArcArena::resource()), 
+  _gGround(ArcArena::resource()), _gSum(ArcArena::resource()),
+  _diag(ArcArena::resource()), _rhs(ArcArena::resource()),
+  _voltages(ArcArena::resource()), _history(ArcArena::resource()),
+  _prevVoltages(ArcArena::resource()), _recordIndex(ArcArena::resource()),
+  _crossingWaveform(ArcArena::resource()), _latestValues(ArcArena::resource())
+{
+}
+
+NetSimulator::~NetSimulator() = default;
+
+void
+NetSimulator::setTerminationVoltage(size_t nodeId, bool isRise, double voltage)
+{
+  _terminations.push_back({nodeId, _net.nodeIndex(nodeId), isRise, voltage, false});
+}
+
+void
+NetSimulator::addStimulus(size_t vSrcId)
+{
+  if (vSrcId == static_cast<size_t>(-1)) {
+    return;
+  }
+  const Device& src = _ckt->device(vSrcId);
+  if (src._type != DeviceType::VoltageSource || _ckt->node(src._negNode)._isGround == false) {
+    return;
+  }
+  _stimuli.push_back(vSrcId);
+}
+
+void
+NetSimulator::watchCrossings(size_t nodeId, const std::vector<double>& thresholds)
+{
+  recordNode(nodeId);
+  _watches.push_back({nodeId, thresholds});
+}
+
+double
+NetSimulator::latestVoltage(size_t nodeId) const
+{
+  if (_simulator) {
+    return _simulator->simulationResult().latestVoltage(nodeId);
+  }
+  size_t index = _net.nodeIndex(nodeId);
+  if (index < _voltages.size()) {
+    return _voltages[index];
+  }
+  const auto& found = _result._waveformIndex.find(nodeId);
+  if (found != _result._waveformIndex.end() && found->second < _latestValues.size()) {
+    return _latestValues[found->second];
+  }
+  return _result.latestVoltage(nodeId);
+}
+
+double
+NetSimulator::currentTime() const
+{
+  if (_simulator) {
+    return _simulator->simulationResult().currentTime();
+  }
+  return _result.currentTime();
+}
+
+void
+NetSimulator::loadDeviceValues()
+{
+  size_t n = _net.size();
+  _cap.assign(n, 0);
+  _gParent.assign(n, 0);
+  _gGround.assign(n, 0);
+  _gSum.assign(n, 0);
+  for (size_t i=0; i<n; ++i) {
+    const RCNet::NetNode& node = _net.node(i);
+    for (size_t capId : node._caps) {
+      _cap[i] += _ckt->device(capId)._value;
+    }
+    for (size_t resId : node._groundRes) {
+      _gGround[i] += 1.0 / _ckt->device(resId)._value;
+    }
+    _gSum[i] += _gGround[i];
+    if (node._parentRes != static_cast<size_t>(-1)) {
+      double g = 1.0 / _ckt->device(node._parentRes)._value;
+      _gParent[i] = g;
+      _gSum[i] += g;
+      _gSum[node._parent] += g;
+    }
+  }
+  _sourceCouplings.clear();
+  const std::vector<size_t>& drivers = _net.nodeDrivers();
+  for (size_t capId : _net.couplingCaps()) {
+    const Device& cap = _ckt->device(capId);
+    bool isPosDriven = (drivers[_net.nodeIndex(cap._posNode)] == 0);
+    bool isNegDriven = (drivers[_net.nodeIndex(cap._negNode)] == 0);
+    if (isPosDriven != isNegDriven) {
+      _sourceCouplings.push_back(capId);
+    }
+  }
+}
+
+double
+NetSimulator::aggressorVoltage(size_t k, double time) const
+{
+  const RCNet::Aggressor& aggressor = _net.aggressors()[k];
+  const PWLValue& pwl = _ckt->PWLData(_ckt->device(aggressor._srcDevId));
+  const auto& found = _aggressorOffsets.find(aggressor._srcDevId);
+  if (found == _aggressorOffsets.end()) {
+    return aggressor._sign * PWLValueAt(pwl, 0);
+  }
+  return aggressor._sign * PWLValueAt(pwl, time - found->second);
+}
+
+/// Coupling capacitors to aggressor nets carry charge of the net source,
+/// capacitors of the aggressor nets do not
+void
+NetSimulator::sourceCharge(double& capCharge, double& groundCurrent) const
+{
+  capCharge = 0;
+  groundCurrent = 0;
+  const std::vector<size_t>& drivers = _net.nodeDrivers();
+  for (size_t i=0; i<_net.size(); ++i) {
+    if (drivers[i] == 0) {
+      groundCurrent += _gGround[i] * _voltages[i];
+      capCharge += _cap[i] * _voltages[i];
+    }
+  }
+  for (size_t capId : _sourceCouplings) {
+    const Device& cap = _ckt->device(capId);
+    size_t posIndex = _net.nodeIndex(cap._posNode);
+    size_t negIndex = _net.nodeIndex(cap._negNode);
+    double v = _voltages[posIndex] - _voltages[negIndex];
+    capCharge += (drivers[posIndex] == 0 ? v : -v) * cap._value;
+  }
+}
+
+typedef Eigen::Triplet<double> Triplet;
+
+static void
+stampBranch(std::vector<Triplet>& triplets, size_t a, size_t b, double value)
+{
+  triplets.push_back(Triplet(a, a, value));
+  triplets.push_back(Triplet(b, b, value));
+  triplets.push_back(Triplet(a, b, -value));
+  triplets.push_back(Triplet(b, a, -value));
+}
+
+/// Builds G and C of the whole net, and the matrix rows of the nodes other than
+/// the root and the aggressor nodes, whose voltages are given by their sources.
+/// Every entry is stamped even if its value is 0, so that the matrix pattern
+/// only depends on the net topology.
+void
+NetSimulator::buildNetMatrices()
+{
+  size_t n = _net.size();
+  std::vector<Triplet> gTriplets;
+  std::vector<Triplet> cTriplets;
+  for (size_t i=0; i<n; ++i) {
+    gTriplets.push_back(Triplet(i, i, _gGround[i]));
+    cTriplets.push_back(Triplet(i, i, _cap[i]));
+  }
+  for (size_t resId : _net.resistors()) {
+    const Device& res = _ckt->device(resId);
+    stampBranch(gTriplets, _net.nodeIndex(res._posNode),
+                _net.nodeIndex(res._negNode), 1.0 / res._value);
+  }
+  for (size_t capId : _net.couplingCaps()) {
+    const Device& cap = _ckt->device(capId);
+    stampBranch(cTriplets, _net.nodeIndex(cap._posNode),
+                _net.nodeIndex(cap._negNode), cap._value);
+  }
+  _G.resize(n, n);
+  _G.setFromTriplets(gTriplets.begin(), gTriplets.end());
+  _C.resize(n, n);
+  _C.setFromTriplets(cTriplets.begin(), cTriplets.end());
+
+  const std::vector<RCNet::Aggressor>& aggressors = _net.aggressors();
+  _fixedSlots.assign(n, invalidIndex);
+  if (_net.isCurrentDriven() == false) {
+    _fixedSlots[0] = 0;
+  }
+  for (size_t k=0; k<aggressors.size(); ++k) {
+    _fixedSlots[aggressors[k]._nodeIndex] = k + 1;
+  }
+  _unknownRows.assign(n, invalidIndex);
+  _unknownNodes.clear();
+  for (size_t i=0; i<n; ++i) {
+    if (_fixedSlots[i] == invalidIndex) {
+      _unknownRows[i] = _unknownNodes.size();
+      _unknownNodes.push_back(i);
+    }
+  }
+}
+
+/// G+alpha*C of the unknown nodes, the columns of the fixed nodes are moved to the right hand side
+void
+NetSimulator::buildMatrix()
+{
+  buildNetMatrices();
+  size_t m = _unknownNodes.size();
+  std::vector<Triplet> triplets;
+  _fixedColumns.setZero(m, _net.aggressors().size() + 1);
+  auto addEntries = [&](const SparseMatrix& matrix, double scale) {
+    for (Eigen::Index col=0; col<matrix.outerSize(); ++col) {
+      for (SparseMatrix::InnerIterator it(matrix, col); it; ++it) {
+        size_t row = _unknownRows[it.row()];
+        if (row == invalidIndex) {
+          continue;
+        }
+        size_t unknownCol = _unknownRows[it.col()];
+        if (unknownCol != invalidIndex) {
+          triplets.push_back(Triplet(row, unknownCol, scale * it.value()));
+        } else {
+          _fixedColumns(row, _fixedSlots[it.col()]) += scale * it.value();
+        }
+      }
+    }
+  };
+  addEntries(_G, 1);
+  addEntries(_C, _alpha);
+  _matrix.resize(m, m);
+  _matrix.setFromTriplets(triplets.begin(), triplets.end());
+  _matrix.makeCompressed();
+  if (!_factor) {
+    _factor = SparseLUCache::entry(_matrix);
+  }
+}
+
+/// Solves (G + alpha*C) * v = rhs with v(root) = srcValue for voltage sources,
+/// or with srcValue injected into the root for current sources.
+/// Leaves are eliminated into their parents first,
+/// then voltages are substituted back from the root.
+bool
+NetSimulator::solveTree(double srcValue)
+{
+  size_t n = _net.size();
+  const std::vector<size_t>& order = _net.order();
+  bool isRootFixed = (_net.isCurrentDriven() == false);
+  for (size_t i=0; i<n; ++i) {
+    _diag[i] = _alpha * _cap[i] + _gSum[i];
+    _rhs[i] = _alpha * _cap[i] * _history[i];
+  }
+  if (_isTrapezoidal) {
+    /// Add -G*v(t) + source injection of the previous time point
+    for (size_t k=1; k<order.size(); ++k) {
+      size_t i = order[k];
+      size_t p = _net.node(i)._parent;
+      double current = _gParent[i] * (_voltages[p] - _voltages[i]);
+      _rhs[i] += current;
+      if (p != 0 || isRootFixed == false) {
+        _rhs[p] -= current;
+      }
+    }
+    for (size_t i=(isRootFixed ? 1 : 0); i<n; ++i) {
+      _rhs[i] -= _gGround[i] * _voltages[i];
+    }
+  }
+  for (size_t k=order.size()-1; k>0; --k) {
+    size_t i = order[k];
+    size_t p = _net.node(i)._parent;
+    if (p == 0 && isRootFixed) {
+      continue;
+    }
+    double r = _gParent[i] / _diag[i];
+    _diag[p] -= _gParent[i] * r;
+    _rhs[p] += r * _rhs[i];
+  }
+  _voltages[0] = isRootFixed ? srcValue : (_rhs[0] + srcValue) / _diag[0];
+  for (size_t k=1; k<order.size(); ++k) {
+    size_t i = order[k];
+    size_t p = _net.node(i)._parent;
+    _voltages[i] = (_rhs[i] + _gParent[i] * _voltages[p]) / _diag[i];
+  }
+  return true;
+}
+
+bool
+NetSimulator::solveSparse(double srcValue)
+{
+  if (SparseLUCache::factorize(*_factor, _matrix) == false) {
+    return false;
+  }
+  size_t n = _net.size();
+  Eigen::Map<Eigen::VectorXd> v(_voltages.data(), n);
+  Eigen::Map<const Eigen::VectorXd> vh(_history.data(), n);
+  _historyRhs = _alpha * (_C * vh);
+  if (_isTrapezoidal) {
+    _historyRhs -= _G * v;
+  }
+  bool isRootFixed = (_net.isCurrentDriven() == false);
+  if (isRootFixed) {
+    _fixedVoltages(0) = srcValue;
+  } else {
+    _historyRhs(0) += srcValue;
+  }
+  size_t m = _unknownNodes.size();
+  _stepRhs.resize(m);
+  for (size_t row=0; row<m; ++row) {
+    _stepRhs(row) = _historyRhs(_unknownNodes[row]);
+  }
+  _stepRhs -= _fixedColumns * _fixedVoltages;
+  _historyRhs.head(m) = _factor->_solver.solve(_stepRhs);
+  for (size_t row=0; row<m; ++row) {
+    v(_unknownNodes[row]) = _historyRhs(row);
+  }
+  if (isRootFixed) {
+    v(0) = srcValue;
+  }
+  const std::vector<RCNet::Aggressor>& aggressors = _net.aggressors();
+  for (size_t k=0; k<aggressors.size(); ++k) {
+    v(aggressors[k]._nodeIndex) = _fixedVoltages(k + 1);
+  }
+  return true;
+}
+
+/// Solves G * v = b with the values of the sources at time 0
+void
+NetSimulator::solveOperatingPoint(double srcValue, bool isTree)
+{
+  _isTrapezoidal = false;
+  if (isTree) {
+    /// Alpha is still 0, so this is the DC solution of the tree
+    solveTree(srcValue);
+    return;
+  }
+  buildNetMatrices();
+  size_t n = _net.size();
+  size_t m = _unknownNodes.size();
+  Eigen::Map<Eigen::VectorXd> v(_voltages.data(), n);
+  Eigen::VectorXd fixedVoltages = v;
+  for (size_t i : _unknownNodes) {
+    fixedVoltages(i) = 0;
+  }
+  const Eigen::VectorXd& fixedCurrents = _G * fixedVoltages;
+  std::vector<Triplet> triplets;
+  Eigen::VectorXd rhs(m);
+  for (size_t row=0; row<m; ++row) {
+    triplets.push_back(Triplet(row, row, gmin));
+    rhs(row) = -fixedCurrents(_unknownNodes[row]);
+  }
+  if (_net.isCurrentDriven()) {
+    rhs(_unknownRows[0]) += srcValue;
+  }
+  for (Eigen::Index col=0; col<_G.outerSize(); ++col) {
+    for (SparseMatrix::InnerIterator it(_G, col); it; ++it) {
+      size_t row = _unknownRows[it.row()];
+      size_t unknownCol = _unknownRows[it.col()];
+      if (row != invalidIndex && unknownCol != invalidIndex) {
+        triplets.push_back(Triplet(row, unknownCol, it.value()));
+      }
+    }
+  }
+  SparseMatrix matrix(m, m);
+  matrix.setFromTriplets(triplets.begin(), triplets.end());
+  matrix.makeCompressed();
+  SparseLUSolver solver;
+  solver.compute(matrix);
+  if (solver.info() != Eigen::Success) {
+    printf("WARNING: Cannot solve the DC operating point of the net, nodes start at the source voltages\n");
+    return;
+  }
+  const Eigen::VectorXd& solution = solver.solve(rhs);
+  for (size_t row=0; row<m; ++row) {
+    v(_unknownNodes[row]) = solution(row);
+  }
+}
+
+void
+NetSimulator::setAlpha(double alpha, bool isTree)
+{
+  if (alpha == _alpha) {
+    return;
+  }
+  _alpha = alpha;
+  if (isTree == false) {
+    buildMatrix();
+  }
+}
+
+/// Advances the net voltages from time-h to time.
+/// Gear2 starts with one backward Euler step.
+/// The two stages of TRBDF2 with gamma = 2-sqrt(2) share the same alpha,
+/// so the matrix of sparse nets is factorized once for both.
+/// Current sources of trapezoidal stages inject the sum of their currents
+/// at both ends of the stage.
+bool
+NetSimulator::solveStep(double time, double h, bool isTree)
+{
+  const PWLValue& srcData = _ckt->PWLData(_ckt->device(_net.sourceId()));
+  double sign = _net.sourceSign();
+  auto solve = [&](double t, double tStart) {
+    double srcValue = sign * PWLValueAt(srcData, t);
+    if (_net.isCurrentDriven() && _isTrapezoidal) {
+      srcValue += sign * PWLValueAt(srcData, tStart);
+    }
+    for (size_t k=0; k+1<static_cast<size_t>(_fixedVoltages.size()); ++k) {
+      _fixedVoltages(k + 1) = aggressorVoltage(k, t);
+    }
+    return isTree ? solveTree(srcValue) : solveSparse(srcValue);
+  };
+  size_t n = _net.size();
+  bool isFirstStep = _isFirstStep;
+  _isFirstStep = false;
+  switch (_intMode) {
+    case IntegrateMode::Gear2:
+      _isTrapezoidal = false;
+      if (isFirstStep) {
+        setAlpha(1 / h, isTree);
+        _history = _voltages;
+      } else {
+        setAlpha(1.5 / h, isTree);
+        for (size_t i=0; i<n; ++i) {
+          _history[i] = (4 * _voltages[i] - _prevVoltages[i]) / 3;
+        }
+      }
+      _prevVoltages = _voltages;
+      return solve(time, time - h);
+    case IntegrateMode::TRBDF2: {
+      const double gamma = 2 - std::sqrt(2.0);
+      setAlpha(2 / (gamma * h), isTree);
+      _isTrapezoidal = true;
+      _history = _voltages;
+      _prevVoltages = _voltages;
+      if (solve(time - h + gamma * h, time - h) == false) {
+        return false;
+      }
+      _isTrapezoidal = false;
+      double a = 1 / (gamma * (2 - gamma));
+      double b = (1 - gamma) * (1 - gamma) * a;
+      for (size_t i=0; i<n; ++i) {
+        _history[i] = a * _voltages[i] - b * _prevVoltages[i];
+      }
+      return solve(time, time - h + gamma * h);
+    }
+    default:
+      _isTrapezoidal = (_intMode == IntegrateMode::Trapezoidal);
+      setAlpha((_isTrapezoidal ? 2 : 1) / h, isTree);
+      _history = _voltages;
+      return solve(time, time - h);
+  }
+}
+
+double
+NetSimulator::stepScale(IntegrateMode mode, const RCNet& net)
+{
+  if (net.isValid() && (mode == IntegrateMode::Gear2 || mode == IntegrateMode::TRBDF2)) {
+    return lStableStepFactor * stepFactor;
+  }
+  return stepFactor;
+}
+
+void
+NetSimulator::setStepFactor(double factor)
+{
+  if (factor > 0) {
+    stepFactor = factor;
+  }
+}
+
+void
+NetSimulator::setLStableStepFactor(double factor)
+{
+  if (factor > 0) {
+    lStableStepFactor = factor;
+  }
+}
+
+void
+NetSimulator::initResult()
+{
+  _result.clear();
+  _recordIndex.clear();
+  size_t n = _net.size();
+  if (_recordNodes.empty()) {
+    for (size_t i=0; i<n; ++i) {
+      _recordIndex.push_back(i);
+    }
+  } else {
+    std::vector<bool> isRecorded(n, false);
+    for (size_t nodeId : _recordNodes) {
+      size_t index = _net.nodeIndex(nodeId);
+      if (index < n && isRecorded[index] == false) {
+        isRecorded[index] = true;
+        _recordIndex.push_back(index);
+      }
+    }
+  }
+  for (size_t index : _recordIndex) {
+    _result.addWaveform(_net.node(index)._nodeId);
+  }
+  for (size_t srcId : _stimuli) {
+    _result.addWaveform(_ckt->device(srcId)._posNode);
+  }
+  _result.setCompact(_isCompact);
+  _latestValues.clear();
+  _crossingWaveform.clear();
+  for (const auto& watch : _watches) {
+    const auto& found = _result._waveformIndex.find(watch.first);
+    if (found == _result._waveformIndex.end() || 
+        _result._crossingIndex.count(watch.first) > 0) {
+      continue;
+    }
+    _result._crossingIndex.insert({watch.first, _result._crossings.size()});
+    _result._crossings.push_back(CrossingDetector(watch.second));
+    _crossingWaveform.push_back(found->second);
+  }
+}
+
+void
+NetSimulator::addTimePoint(double time, double charge)
+{
+  size_t numRecorded = _recordIndex.size();
+  _latestValues.resize(numRecorded + _stimuli.size());
+  for (size_t i=0; i<numRecorded; ++i) {
+    _latestValues[i] = _voltages[_recordIndex[i]];
+  }
+  for (size_t j=0; j<_stimuli.size(); ++j) {
+    const PWLValue& pwl = _ckt->PWLData(_ckt->device(_stimuli[j]));
+    _latestValues[numRecorded+j] = PWLValueAt(pwl, time);
+  }
+  _result.addSamples(time, _latestValues);
+  for (size_t k=0; k<_crossingWaveform.size(); ++k) {
+    _result._crossings[k].addPoint(time, _latestValues[_crossingWaveform[k]]);
+  }
+  _result._sourceCharge.addPoint(time, charge);
+  _result._currentTime = time;
+}
+
+bool
+NetSimulator::terminated()
+{
+  if (_terminationFunc && _terminationFunc()) {
+    return true;
+  }
+  if (_terminations.empty()) {
+    return false;
+  }
+  bool allReached = true;
+  for (Termination& term : _terminations) {
+    if (term._reached == false && term._index < _voltages.size()) {
+      double v = _voltages[term._index];
+      if (term._isRise) {
+        term._reached = (v >= term._voltage);
+      } else {
+        term._reached = (v <= term._voltage);
+      }
+    }
+    allReached = allReached && term._reached;
+  }
+  return allReached;
+}
+
+/// Nets that are not linear RC nets are simulated by the general simulator,
+/// results on the net nodes are then copied into NetSimResult
+void
+NetSimulator::runSimulator()
+{
+  AnalysisParameter param = _param;
+  param._intMethod = IntegrateMethod::Trapezoidal;
+  if (_intMode == IntegrateMode::BackwardEuler) {
+    param._intMethod = IntegrateMethod::BackwardEuler;
+  }
+  _simulator.reset(new Simulator(*_ckt, param));
+  for (const Termination& term : _terminations) {
+    _simulator->setTerminationVoltage(term._nodeId, term._isRise, term._voltage);
+  }
+  if (_updateFunc) {
+    _simulator->setUpdateFunction(_updateFunc);
+  }
+  _simulator->run();
+  /// Waveforms are copied from the simulator result, they are not stored compact
+  _result.setCompact(false);
+  const SimResult& simResult = _simulator->simulationResult();
+  size_t numRecorded = _recordIndex.size();
+  for (size_t i=0; i<numRecorded; ++i) {
+    size_t nodeId = _net.node(_recordIndex[i])._nodeId;
+    _result._waveforms[i] = simResult.nodeVoltageWaveform(nodeId);
+  }
+  const Waveform& rootWaveform = simResult.nodeVoltageWaveform(_net.node(0)._nodeId);
+  for (size_t j=0; j<_stimuli.size(); ++j) {
+    const PWLValue& pwl = _ckt->PWLData(_ckt->device(_stimuli[j]));
+    Waveform& waveform = _result._waveforms[numRecorded+j];
+    for (const auto& p : rootWaveform.data()) {
+      waveform.addPoint(p._time, PWLValueAt(pwl, p._time));
+    }
+  }
+  const Device& src = _ckt->device(_net.sourceId());
+  double charge = 0;
+  double prevTime = 0;
+  for (const auto& p : rootWaveform.data()) {
+    charge += simResult.chargeBetween(src, prevTime, p._time);
+    _result._sourceCharge.addPoint(p._time, charge);
+    prevTime = p._time;
+  }
+  for (size_t k=0; k<_crossingWaveform.size(); ++k) {
+    const Waveform& waveform = _result._waveforms[_crossingWaveform[k]];
+    for (const auto& p : waveform.data()) {
+      _result._crossings[k].addPoint(p._time, p._value);
+    }
+  }
+  _result._currentTime = simResult.currentTime();
+  _result._stepCount = rootWaveform.size() > 0 ? rootWaveform.size() - 1 : 0;
+  _simulator.reset();
+}
+
+void
+NetSimulator::run()
+{
+  if (_net.size() == 0) {
+    printf("ERROR: Cannot find the driving source of the net\n");
+    return;
+  }
+  if (_intMode == IntegrateMode::Default) {
+    _intMode = (_param._intMethod == IntegrateMethod::BackwardEuler) ? 
+               IntegrateMode::BackwardEuler : IntegrateMode::Trapezoidal;
+  }
+  initResult();
+  if (_net.isValid() == false) {
+    runSimulator();
+    return;
+  }
+  size_t n = _net.size();
+  const PWLValue& srcData = _ckt->PWLData(_ckt->device(_net.sourceId()));
+  double sign = _net.sourceSign();
+  double h = _param._simTick;
+  bool isTree = _net.isTree();
+  /// Matrix is built when alpha of the first step is set
+  _alpha = 0;
+  _isFirstStep = true;
+  loadDeviceValues();
+
+  /// Without resistors to ground each node starts at the voltage 
+  /// of the source driving it, otherwise at the DC operating point.
+  /// Nets driven by current sources start at 0.
+  double srcValue = sign * PWLValueAt(srcData, 0);
+  _voltages.assign(n, _net.isCurrentDriven() ? 0 : srcValue);
+  _fixedVoltages.setZero(_net.aggressors().size() + 1);
+  const std::vector<size_t>& drivers = _net.nodeDrivers();
+  for (size_t i=0; i<n; ++i) {
+    if (drivers[i] != 0) {
+      _voltages[i] = aggressorVoltage(drivers[i] - 1, 0);
+    }
+  }
+  _diag.resize(n);
+  _rhs.resize(n);
+  _history.resize(n);
+  if (std::any_of(_gGround.begin(), _gGround.end(), [](double g) { return g != 0; })) {
+    solveOperatingPoint(srcValue, isTree);
+  }
+  double charge = 0;
+  addTimePoint(0, charge);
+
+  double time = 0;
+  while (time < _param._simTime) {
+    time += h;
+    double prevCapCharge = 0;
+    double prevGroundCurrent = 0;
+    sourceCharge(prevCapCharge, prevGroundCurrent);
+    if (solveStep(time, h, isTree) == false) {
+      break;
+    }
+    double capCharge = 0;
+    double groundCurrent = 0;
+    sourceCharge(capCharge, groundCurrent);
+    if (_net.isCurrentDriven()) {
+      /// Charge of current sources is the integral of their currents
+      charge += (PWLValueAt(srcData, time - h) + PWLValueAt(srcData, time)) * h / 2;
+    } else {
+      charge += sign * (capCharge - prevCapCharge + (prevGroundCurrent + groundCurrent) * h / 2);
+    }
+    addTimePoint(time, charge);
+    ++_result._stepCount;
+    if (terminated()) {
+      break;
+    }
+    if (_updateFunc && _updateFunc()) {
+      /// Pattern of the matrix is unchanged, only numeric factorization is redone
+      loadDeviceValues();
+      if (isTree == false) {
+        buildMatrix();
+      }
+    }
+  }
+  trace<TraceModule::Sim>(TraceEvent::NetSimulation, n, time, _result._stepCount);
+  if (Debug::enabled(DebugModule::Sim)) {
+    printf("DEBUG: %s simulation of %lu nodes finished in T@%G after %lu steps\n",
+           isTree ? "RC tree" : "Sparse LU", n, time, _result._stepCount);
+    if (_result.isCompact()) {
+      size_t pointCount = _result._times.size() * _result._waveforms.size();
+      printf("DEBUG: Compact waveforms use %lu bytes instead of %lu, largest sample error %G\n",
+             _result.sampleBytes(), pointCount * 2 * sizeof(double), _result.compactError());
+    }
+  }
+}
+
+}
@@ -0,0 +1,254 @@
+#ifndef _NA_NETSIM_H_
+#define _NA_NETSIM_H_
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <Eigen/Sparse>
+#include "Base.h"
+#include "SimResult.h"
+#include "RCNet.h"
+#include "WaveformCrossing.h"
+#include "DelayOptions.h"
+#include "ArcArena.h"
+
+namespace NA {
+
+class Circuit;
+class Simulator;
+
+class NetSimResult {
+  public:
+    NetSimResult() = default;
+    /// Waveforms grow with the net size, results are moved instead of copied
+    NetSimResult(const NetSimResult&) = delete;
+    NetSimResult& operator=(const NetSimResult&) = delete;
+    NetSimResult(NetSimResult&&) = default;
+    NetSimResult& operator=(NetSimResult&&) = default;
+
+    bool empty() const { return _waveforms.empty(); }
+    void clear();
+
+    /// Compact results store the samples of all recorded waveforms as float
+    /// arrays sharing one time array, instead of double time value points.
+    /// Voltages and measurements are still calculated in double.
+    bool isCompact() const { return _isCompact; }
+    /// Largest difference between the stored samples and the simulated voltages
+    double compactError() const { return _compactError; }
+    /// Bytes used by the recorded samples
+    size_t sampleBytes() const;
+
+    /// Returns an empty waveform if the node is not recorded.
+    /// Waveforms of compact results are expanded on first access.
+    const Waveform& nodeVoltageWaveform(size_t nodeId) const;
+    /// Same as Waveform::isRise without expanding compact waveforms
+    bool isRise(size_t nodeId) const;
+    double nodeVoltage(size_t nodeId, double time) const;
+    double latestVoltage(size_t nodeId) const;
+    double currentTime() const { return _currentTime; }
+    size_t stepCount() const { return _stepCount; }
+    /// Charge delivered by the driving source of the net
+    double chargeBetween(double timeStart, double timeEnd) const;
+    double totalCharge() const;
+    /// Threshold crossings detected during simulation, nullptr if the node is not watched
+    const CrossingDetector* crossings(size_t nodeId) const;
+
+  private:
+    friend class NetSimulator;
+
+    void setCompact(bool isCompact) { _isCompact = isCompact; }
+    Waveform& addWaveform(size_t nodeId);
+    /// Appends one sample to every waveform, values are in waveform order
+    void addSamples(double time, const ArenaVector& values);
+
+  private:
+    double                             _currentTime = 0;
+    size_t                             _stepCount = 0;
+    /// Charge is differenced between time points, it is kept in double
+    Waveform                           _sourceCharge;
+    /// Expanded copies of compact waveforms are cached here
+    mutable std::vector<Waveform>      _waveforms;
+    bool                               _isCompact = false;
+    double                             _compactError = 0;
+    std::vector<double>                _times;
+    std::vector<std::vector<float>>    _samples;
+    std::unordered_map<size_t, size_t> _waveformIndex;
+    std::vector<CrossingDetector>      _crossings;
+    std::unordered_map<size_t, size_t> _crossingIndex;
+};
+
+typedef Eigen::SparseMatrix<double> SparseMatrix;
+typedef Eigen::SparseLU<SparseMatrix, Eigen::COLAMDOrdering<int>> SparseLUSolver;
+
+/// Sparse LU factorization shared by all nets with the same matrix pattern.
+/// Ordering and symbolic analysis are done once per pattern,
+/// numeric factorization is only redone when matrix values change.
+/// Each thread has its own cache, so entries are never factorized by two
+/// threads at once. Entries are evicted in least recently used order once
+/// the patterns and factors of a thread use more than capacity() bytes,
+/// evicted entries stay valid for the simulations still holding them.
+class SparseLUCache {
+  public:
+    struct Entry {
+      size_t              _hash = 0;
+      size_t              _bytes = 0;
+      std::vector<int>    _outerIndex;
+      std::vector<int>    _innerIndex;
+      std::vector<double> _values;
+      bool                _isFactorized = false;
+      SparseLUSolver      _solver;
+    };
+
+    static std::shared_ptr<Entry> entry(const SparseMatrix& matrix);
+    /// Make sure the factorization of entry matches matrix values
+    static bool factorize(Entry& entry, const SparseMatrix& matrix);
+    static size_t capacity() { return 64 << 20; }
+    /// Bytes used by the cache of the calling thread
+    static size_t bytes();
+
+  private:
+    static size_t patternHash(const SparseMatrix& matrix);
+    static void evict();
+};
+
+/// Transient simulation of the net driven by a PWL voltage or current source.
+/// RC trees are solved with tree elimination in O(n) per time step,
+/// other linear RC nets with a sparse LU from SparseLUCache.
+/// Nets with other devices are simulated with the general Simulator.
+/// Work vectors are allocated from the ArcArena of the calculated arc.
+class NetSimulator {
+  public:
+    NetSimulator(Circuit& ckt, const RCNet& net, const AnalysisParameter& param);
+    ~NetSimulator();
+
+    /// Stop the simulation once all nodes reach their termination voltages
+    void setTerminationVoltage(size_t nodeId, bool isRise, double voltage);
+    /// Called after each time step, returns true if device values are changed
+    void setUpdateFunction(const std::function<bool(void)>& func) { _updateFunc = func; }
+    /// Called after each time step, the simulation stops if it returns true.
+    /// Not used if the net is simulated by the general Simulator.
+    void setTerminationFunction(const std::function<bool(void)>& func) { _terminationFunc = func; }
+    /// Record the voltage of a node driven by a grounded PWL source outside of the net,
+    /// such as the input pin of the driver cell
+    void addStimulus(size_t vSrcId);
+    /// Only waveforms of the nodes added here are recorded,
+    /// all net nodes are recorded if no node is added.
+    /// Stimuli and the source charge are always recorded.
+    void recordNode(size_t nodeId) { _recordNodes.push_back(nodeId); }
+    /// Record the node and detect crossings of thresholds as they happen
+    void watchCrossings(size_t nodeId, const std::vector<double>& thresholds);
+    /// Store recorded waveforms in the compact form of NetSimResult,
+    /// crossings are still detected on the simulated voltages
+    void setCompactWaveforms(bool isCompact) { _isCompact = isCompact; }
+    /// Overrides the integration method of the analysis parameter,
+    /// Gear2 and TRBDF2 are simulated as trapezoidal by the general Simulator
+    void setIntegrateMode(IntegrateMode mode) { _intMode = mode; }
+    /// Aggressors of the net switch with their PWL sources delayed by offset,
+    /// aggressors without an offset are quiet at their initial voltage.
+    /// Offsets do not change the matrix, its factorization is reused.
+    void setAggressorOffset(size_t srcDevId, double offset) { _aggressorOffsets[srcDevId] = offset; }
+    /// Scale of the default time step of a delay calculation. Steps of the
+    /// L-stable second order methods are further scaled by the L-stable factor.
+    /// Nets simulated by the general Simulator use trapezoidal, their steps are not enlarged.
+    static double stepScale(IntegrateMode mode, const RCNet& net);
+    /// Scales the time steps of all later net simulations, 
+    /// small factors are used for reference results
+    static void setStepFactor(double factor);
+    /// Scales the time steps of later Gear2 and TRBDF2 net simulations on top
+    /// of the step factor, 1 by default. Larger steps trade accuracy for speed,
+    /// the error is not estimated.
+    static void setLStableStepFactor(double factor);
+
+    void run();
+    const NetSimResult& simulationResult() const { return _result; }
+    /// Moves the result out of the simulator
+    NetSimResult releaseResult() { return std::move(_result); }
+    /// Can be used in the update function during simulation
+    double latestVoltage(size_t nodeId) const;
+    double currentTime() const;
+
+  private:
+    struct Termination {
+      size_t _nodeId;
+      size_t _index;
+      bool   _isRise;
+      double _voltage;
+      bool   _reached;
+    };
+
+    void loadDeviceValues();
+    void buildNetMatrices();
+    void buildMatrix();
+    void solveOperatingPoint(double srcValue, bool isTree);
+    double aggressorVoltage(size_t k, double time) const;
+    /// Charge in the capacitors and current to ground driven by the net source
+    void sourceCharge(double& capCharge, double& groundCurrent) const;
+    void setAlpha(double alpha, bool isTree);
+    bool solveTree(double srcValue);
+    bool solveSparse(double srcValue);
+    bool solveStep(double time, double h, bool isTree);
+    void initResult();
+    void addTimePoint(double time, double charge);
+    bool terminated();
+    void runSimulator();
+
+  private:
+    Circuit*                 _ckt;
+    const RCNet&             _net;
+    AnalysisParameter        _param;
+    IntegrateMode            _intMode = IntegrateMode::Default;
+    bool                     _isCompact = false;
+    /// Trapezoidal terms are added to the equations of the current stage
+    bool                     _isTrapezoidal = true;
+    /// Equations of all methods are solved as (G + alpha*C) * v = alpha*C*vh,
+    /// plus -G*v(t) for trapezoidal, where vh is _history
+    double                   _alpha = 0;
+    bool                     _isFirstStep = true;
+    ArenaVector              _cap;
+    ArenaVector              _gParent;
+    ArenaVector              _gGround;
+    ArenaVector              _gSum;
+    ArenaVector              _diag;
+    ArenaVector              _rhs;
+    ArenaVector              _voltages;
+    ArenaVector              _history;
+    /// Voltages of the previous time point for Gear2, and of the
+    /// trapezoidal stage for TRBDF2
+    ArenaVector              _prevVoltages;
+    SparseMatrix             _G;
+    SparseMatrix             _C;
+    SparseMatrix             _matrix;
+    /// Net index of each matrix row, the voltages of the root and the aggressor nodes are given
+    std::vector<size_t>      _unknownNodes;
+    /// Matrix row of each net node, and the right hand side column of each given node
+    std::vector<size_t>      _unknownRows;
+    std::vector<size_t>      _fixedSlots;
+    /// Matrix columns of the root and the aggressor nodes, moved to the right hand side
+    Eigen::MatrixXd          _fixedColumns;
+    Eigen::VectorXd          _fixedVoltages;
+    /// Coupling capacitors between nodes driven by the net source and other nodes
+    std::vector<size_t>      _sourceCouplings;
+    Eigen::VectorXd          _historyRhs;
+    Eigen::VectorXd          _stepRhs;
+    std::shared_ptr<SparseLUCache::Entry> _factor;
+    std::unordered_map<size_t, double> _aggressorOffsets;
+    std::vector<size_t>      _stimuli;
+    std::vector<size_t>      _recordNodes;
+    /// Net indices of the recorded nodes, in the order of result waveforms
+    ArenaIndexVector         _recordIndex;
+    std::vector<std::pair<size_t, std::vector<double>>> _watches;
+    /// Result waveform index of each crossing detector
+    ArenaIndexVector         _crossingWaveform;
+    /// Values of the latest time point of all result waveforms
+    ArenaVector              _latestValues;
+    std::vector<Termination> _terminations;
+    std::function<bool(void)> _updateFunc;
+    std::function<bool(void)> _terminationFunc;
+    std::unique_ptr<Simulator> _simulator;
+    NetSimResult             _result;
+};
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include <cmath>
+#include <Eigen/Dense>
+#include "PiModel.h"
+#include "RCNet.h"
+#include "Circuit.h"
+#include "Debug.h"
+
+namespace NA {
+
+PiModel::PiModel(const Circuit* ckt, const RCNet& net, size_t driverResId)
+{
+  if (net.isTree() == false) {
+    return;
+  }
+  size_t n = net.size();
+  size_t drivingPoint = n;
+  for (size_t i=1; i<n; ++i) {
+    const RCNet::NetNode& node = net.node(i);
+    if (node._groundRes.empty() == false) {
+      return;
+    }
+    if (node._parent == 0) {
+      if (node._parentRes != driverResId || drivingPoint != n) {
+        return;
+      }
+      drivingPoint = i;
+    }
+  }
+  if (drivingPoint == n) {
+    return;
+  }
+  /// Admittance moments of every subtree, accumulated from the leaves.
+  /// Seen through resistor R, Y becomes Y/(1+R*Y), whose moments are
+  /// y1, y2 - R*y1^2 and y3 - 2*R*y1*y2 + R^2*y1^3.
+  std::vector<double> y1(n, 0);
+  std::vector<double> y2(n, 0);
+  std::vector<double> y3(n, 0);
+  for (size_t i=1; i<n; ++i) {
+    for (size_t capId : net.node(i)._caps) {
+      y1[i] += ckt->device(capId)._value;
+    }
+  }
+  const std::vector<size_t>& order = net.order();
+  for (size_t k=order.size()-1; k>0; --k) {
+    size_t i = order[k];
+    size_t p = net.node(i)._parent;
+    if (p == 0) {
+      continue;
+    }
+    double r = ckt->device(net.node(i)._parentRes)._value;
+    y1[p] += y1[i];
+    y2[p] += y2[i] - r * y1[i] * y1[i];
+    y3[p] += y3[i] - 2 * r * y1[i] * y2[i] + r * r * y1[i] * y1[i] * y1[i];
+  }
+  double m1 = y1[drivingPoint];
+  double m2 = y2[drivingPoint];
+  double m3 = y3[drivingPoint];
+  _isValid = true;
+  if (m2 == 0 || m3 == 0) {
+    /// Lumped capacitance, no resistive shielding
+    _c1 = m1;
+  } else {
+    _c2 = m2 * m2 / m3;
+    _c1 = m1 - _c2;
+    _r = -m3 * m3 / (m2 * m2 * m2);
+  }
+  if (Debug::enabled(DebugModule::NLDM)) {
+    printf("DEBUG: Pi model of %lu nodes: C1 = %G, R = %G, C2 = %G\n", n, _c1, _r, _c2);
+  }
+}
+
+/// Response of state x' = lambda*x + u to a unit ramp input u = t
+static inline double
+rampResponse(double lambda, double time)
+{
+  if (time <= 0) {
+    return 0;
+  }
+  return (std::exp(lambda * time) - 1 - lambda * time) / (lambda * lambda);
+}
+
+static inline double
+rampHoldResponse(double lambda, double tDelta, double time)
+{
+  return rampResponse(lambda, time) - rampResponse(lambda, time - tDelta);
+}
+
+double
+PiModel::rampCharge(double rd, double tDelta, double vdd, double time) const
+{
+  double slope = vdd / tDelta;
+  if (_r <= 0 || _c2 <= 0 || _c1 <= 0) {
+    /// Single pole, x' = (slope*t - x)/(rd*c) and charge is c*x
+    double c = totalCap();
+    if (c <= 0) {
+      return 0;
+    }
+    return slope / rd * rampHoldResponse(-1 / (rd * c), tDelta, time);
+  }
+  /// Voltages on C1 and C2 follow x' = A*x + b*slope*t, 
+  /// solved with the eigen decomposition of A
+  Eigen::Matrix2d A;
+  A << -(1/rd + 1/_r) / _c1, 1 / (_r * _c1),
+       1 / (_r * _c2),       -1 / (_r * _c2);
+  double trace = A(0, 0) + A(1, 1);
+  double det = A.determinant();
+  double disc = std::sqrt(trace * trace / 4 - det);
+  double lambda1 = trace / 2 + disc;
+  double lambda2 = trace / 2 - disc;
+  Eigen::Matrix2d P;
+  P << A(0, 1),           A(0, 1),
+       lambda1 - A(0, 0), lambda2 - A(0, 0);
+  Eigen::Vector2d b(slope / (rd * _c1), 0);
+  Eigen::Vector2d modal = P.inverse() * b;
+  modal(0) *= rampHoldResponse(lambda1, tDelta, time);
+  modal(1) *= rampHoldResponse(lambda2, tDelta, time);
+  Eigen::Vector2d v = P * modal;
+  return _c1 * v(0) + _c2 * v(1);
+}
+
+}
@@ -0,0 +1,41 @@
+#ifndef _NA_PIMODEL_H_
+#define _NA_PIMODEL_H_
+
+#include "Base.h"
+
+namespace NA {
+
+class Circuit;
+class RCNet;
+
+/// Pi model of the net seen from the driver output (O'Brien-Savarino):
+/// C1 on the driving point, connected to C2 through R.
+/// Matched to the first three moments of the driving point admittance
+/// y1*s + y2*s^2 + y3*s^3.
+class PiModel {
+  public:
+    PiModel() = default;
+    /// Only RC tree nets driven through driverResId are reduced,
+    /// isValid() is false for other nets
+    PiModel(const Circuit* ckt, const RCNet& net, size_t driverResId);
+
+    bool isValid() const { return _isValid; }
+    double C1() const { return _c1; }
+    double R() const { return _r; }
+    double C2() const { return _c2; }
+    double totalCap() const { return _c1 + _c2; }
+
+    /// Charge delivered into the model at time, by a voltage ramping 
+    /// from 0 to vdd in tDelta and then held, through resistor rd
+    double rampCharge(double rd, double tDelta, double vdd, double time) const;
+
+  private:
+    bool   _isValid = false;
+    double _c1 = 0;
+    double _r = 0;
+    double _c2 = 0;
+};
+
+}
+
+#endif
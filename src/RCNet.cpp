@@ -0,0 +1,200 @@
+#include "RCNet.h"
+#include "Circuit.h"
+#include "CircuitIndex.h"
+#include "Debug.h"
+
+namespace NA {
+
+static size_t invalidId = static_cast<size_t>(-1);
+
+size_t
+RCNet::addNode(size_t nodeId)
+{
+  const auto& found = _nodeIndex.find(nodeId);
+  if (found != _nodeIndex.end()) {
+    return found->second;
+  }
+  size_t index = _nodes.size();
+  NetNode node;
+  node._nodeId = nodeId;
+  _nodes.push_back(node);
+  _nodeIndex.insert({nodeId, index});
+  return index;
+}
+
+size_t
+RCNet::nodeIndex(size_t nodeId) const
+{
+  const auto& found = _nodeIndex.find(nodeId);
+  if (found == _nodeIndex.end()) {
+    return _nodes.size();
+  }
+  return found->second;
+}
+
+RCNet::RCNet(const Circuit* ckt, size_t srcDevId, bool withAggressors)
+: _srcDevId(srcDevId)
+{
+  if (srcDevId == invalidId) {
+    return;
+  }
+  const Device& src = ckt->device(srcDevId);
+  const Node& srcPosNode = ckt->node(src._posNode);
+  const Node& srcNegNode = ckt->node(src._negNode);
+  bool isRC = (srcPosNode._isGround != srcNegNode._isGround);
+  /// Root node is always index 0
+  if (srcPosNode._isGround) {
+    _srcSign = -1;
+    addNode(src._negNode);
+  } else {
+    addNode(src._posNode);
+    if (srcNegNode._isGround == false) {
+      addNode(src._negNode);
+    }
+  }
+
+  const IndexRange<const Device*>& connDevs = CircuitIndex::tracedDevices(ckt, srcDevId);
+  for (const Device* dev : connDevs) {
+    if (dev->_devId == srcDevId) {
+      continue;
+    }
+    const Node& posNode = ckt->node(dev->_posNode);
+    const Node& negNode = ckt->node(dev->_negNode);
+    if (posNode._isGround && negNode._isGround) {
+      continue;
+    }
+    size_t nodeId = posNode._isGround ? dev->_negNode : dev->_posNode;
+    bool isGrounded = posNode._isGround || negNode._isGround;
+    /// Nodes of unsupported devices are still collected,
+    /// they are recorded when the net falls back to the general simulator
+    size_t index = addNode(nodeId);
+    if (isGrounded == false) {
+      addNode(dev->_negNode);
+    }
+    if (dev->_type == DeviceType::Resistor) {
+      if (isGrounded) {
+        _nodes[index]._groundRes.push_back(dev->_devId);
+      } else {
+        _resistors.push_back(dev->_devId);
+      }
+    } else if (dev->_type == DeviceType::Capacitor) {
+      if (isGrounded) {
+        _nodes[index]._caps.push_back(dev->_devId);
+      } else {
+        _couplingCaps.push_back(dev->_devId);
+      }
+    } else if (withAggressors && dev->_type == DeviceType::VoltageSource && 
+               dev->_isInternal && isGrounded) {
+      Aggressor aggressor;
+      aggressor._srcDevId = dev->_devId;
+      aggressor._nodeIndex = index;
+      aggressor._sign = posNode._isGround ? -1 : 1;
+      _aggressors.push_back(aggressor);
+    } else {
+      isRC = false;
+    }
+  }
+  if (isRC == false) {
+    return;
+  }
+  buildTree(ckt);
+  buildNodeDrivers(ckt);
+  _isCurrentDriven = (src._type == DeviceType::CurrentSource);
+  _isValid = (src._type == DeviceType::VoltageSource || _isCurrentDriven);
+  if (_isValid == false) {
+    return;
+  }
+  if (Debug::enabled(DebugModule::Sim)) {
+    printf("DEBUG: Net driven by %s %s has %lu nodes, %lu resistors and %lu aggressors, %s\n",
+           _isCurrentDriven ? "current source" : "voltage source", src._name.data(), 
+           _nodes.size(), _resistors.size(), _aggressors.size(),
+           _isTree ? "solved as RC tree" : "solved with sparse LU");
+  }
+}
+
+void
+RCNet::buildTree(const Circuit* ckt)
+{
+  _isTree = false;
+  if (_couplingCaps.empty() == false || _aggressors.empty() == false || 
+      _resistors.size() + 1 != _nodes.size()) {
+    return;
+  }
+  typedef std::vector<std::pair<size_t, size_t>> Adjacency;
+  std::vector<Adjacency> adjacency(_nodes.size());
+  for (size_t resId : _resistors) {
+    const Device& res = ckt->device(resId);
+    size_t posIndex = nodeIndex(res._posNode);
+    size_t negIndex = nodeIndex(res._negNode);
+    adjacency[posIndex].push_back({negIndex, resId});
+    adjacency[negIndex].push_back({posIndex, resId});
+  }
+  std::vector<bool> visited(_nodes.size(), false);
+  std::vector<size_t> stack;
+  stack.push_back(0);
+  visited[0] = true;
+  _order.clear();
+  _order.reserve(_nodes.size());
+  while (stack.empty() == false) {
+    size_t index = stack.back();
+    stack.pop_back();
+    _order.push_back(index);
+    for (const auto& adj : adjacency[index]) {
+      size_t next = adj.first;
+      if (next == _nodes[index]._parent && adj.second == _nodes[index]._parentRes) {
+        continue;
+      }
+      if (visited[next]) {
+        _order.clear();
+        return;
+      }
+      visited[next] = true;
+      _nodes[next]._parent = index;
+      _nodes[next]._parentRes = adj.second;
+      stack.push_back(next);
+    }
+  }
+  /// With n-1 resistors and no loops every node is reached from the root
+  _isTree = (_order.size() == _nodes.size());
+}
+
+/// Nodes that are not reached through resistors from an aggressor
+/// are driven by the net source
+void
+RCNet::buildNodeDrivers(const Circuit* ckt)
+{
+  _nodeDrivers.assign(_nodes.size(), 0);
+  if (_aggressors.empty()) {
+    return;
+  }
+  std::vector<std::vector<size_t>> adjacency(_nodes.size());
+  for (size_t resId : _resistors) {
+    const Device& res = ckt->device(resId);
+    size_t posIndex = nodeIndex(res._posNode);
+    size_t negIndex = nodeIndex(res._negNode);
+    adjacency[posIndex].push_back(negIndex);
+    adjacency[negIndex].push_back(posIndex);
+  }
+  std::vector<bool> visited(_nodes.size(), false);
+  std::vector<size_t> stack;
+  for (size_t k=0; k<_aggressors.size(); ++k) {
+    stack.push_back(_aggressors[k]._nodeIndex);
+    while (stack.empty() == false) {
+      size_t index = stack.back();
+      stack.pop_back();
+      /// Root is always driven by the net source
+      if (visited[index] || index == 0) {
+        continue;
+      }
+      visited[index] = true;
+      _nodeDrivers[index] = k + 1;
+      for (size_t next : adjacency[index]) {
+        if (visited[next] == false) {
+          stack.push_back(next);
+        }
+      }
+    }
+  }
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef _NA_RCNET_H_
+#define _NA_RCNET_H_
+
+#include <vector>
+#include <unordered_map>
+#include "Base.h"
+
+namespace NA {
+
+class Circuit;
+
+/// Topology of the linear RC network driven by a grounded voltage or current source,
+/// as traced from the source with Circuit::traceDevice.
+/// Only device ids are kept here, device values are read by the solver
+/// so that value updates on the circuit are picked up without rebuilding.
+/// Nets coupled to the net through coupling capacitors are traced with it.
+/// With aggressors, the grounded internal voltage sources of their drivers
+/// are kept as aggressors, otherwise these sources make the net unsupported.
+class RCNet {
+  public:
+    /// Driver source of a coupled net, its node voltage is given by the source
+    struct Aggressor {
+      size_t _srcDevId = static_cast<size_t>(-1);
+      size_t _nodeIndex = 0;
+      double _sign = 1;
+    };
+
+    struct NetNode {
+      size_t              _nodeId = 0;
+      size_t              _parent = static_cast<size_t>(-1);
+      /// Resistor connecting this node to its parent in the tree
+      size_t              _parentRes = static_cast<size_t>(-1);
+      std::vector<size_t> _caps;
+      std::vector<size_t> _groundRes;
+    };
+
+    RCNet() = default;
+    RCNet(const Circuit* ckt, size_t srcDevId, bool withAggressors = false);
+
+    /// The net only contains resistors and capacitors,
+    /// and is driven by one grounded voltage or current source
+    bool isValid() const { return _isValid; }
+    /// The source is a current source, such as the CSM driver, its current
+    /// flows into the root node and the root voltage is solved with the net
+    bool isCurrentDriven() const { return _isCurrentDriven; }
+    /// No resistor loops or coupling capacitors, 
+    /// the net can be solved with tree elimination
+    bool isTree() const { return _isValid && _isTree; }
+    /// Resistors and capacitors form a tree, the source can be of any type
+    bool isTreeTopology() const { return _isTree; }
+
+    size_t size() const { return _nodes.size(); }
+    size_t sourceId() const { return _srcDevId; }
+    /// 1 if the source drives its positive node, -1 if it drives its negative node.
+    /// Current sources drive their positive node with positive values.
+    double sourceSign() const { return _srcSign; }
+
+    const NetNode& node(size_t index) const { return _nodes[index]; }
+    const std::vector<size_t>& resistors() const { return _resistors; }
+    const std::vector<size_t>& couplingCaps() const { return _couplingCaps; }
+    const std::vector<Aggressor>& aggressors() const { return _aggressors; }
+    /// Source driving each node through resistors, 0 for the net source
+    /// and k+1 for aggressor k
+    const std::vector<size_t>& nodeDrivers() const { return _nodeDrivers; }
+    /// Index of circuit node nodeId in this net, or size() if it is not in the net
+    size_t nodeIndex(size_t nodeId) const;
+    /// Node indices in depth first order from the root, which is the node
+    /// driven by the source. Only valid if isTree() is true.
+    const std::vector<size_t>& order() const { return _order; }
+
+  private:
+    size_t addNode(size_t nodeId);
+    void buildTree(const Circuit* ckt);
+    void buildNodeDrivers(const Circuit* ckt);
+
+  private:
+    bool                               _isValid = false;
+    bool                               _isTree = false;
+    bool                               _isCurrentDriven = false;
+    size_t                             _srcDevId = static_cast<size_t>(-1);
+    double                             _srcSign = 1;
+    std::vector<NetNode>               _nodes;
+    std::vector<size_t>                _resistors;
+    std::vector<size_t>                _couplingCaps;
+    std::vector<Aggressor>             _aggressors;
+    std::vector<size_t>                _nodeDrivers;
+    std::vector<size_t>                _order;
+    std::unordered_map<size_t, size_t> _nodeIndex;
+};
+
+}
+
+#endif
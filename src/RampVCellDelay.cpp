@@ -2,10 +2,13 @@
 #include <vector>
 #include <cmath>
 #include "RampVCellDelay.h"
+#include "CircuitIndex.h"
 #include "RootSolver.h"
-#include "Simulator.h"
+#include "NetSimulator.h"
 #include "CommonUtils.h"
+#include "LUTEval.h"
 #include "Debug.h"
+#include "Trace.h"
 
 namespace NA {
 
@@ -13,10 +16,16 @@ static size_t invalidId = static_cast<size_t>(-1);
 static double delayMatchPoint = 20;
 static double rdMatchPoint = 90;
 
+double
+RampVCellDelay::delayMatchFraction()
+{
+  return delayMatchPoint / 100;
+}
+
 double
 totalLoadOnDriver(const Circuit* ckt, size_t rdId)
 {
-  const std::vector<const Device*>& connDevs = ckt->traceDevice(rdId);
+  const IndexRange<const Device*>& connDevs = CircuitIndex::tracedDevices(ckt, rdId);
   double totalCap = 0;
   for (const Device* dev : connDevs) {
     if (dev->_type == DeviceType::Capacitor) {
@@ -55,8 +64,11 @@ calcNLDMLUTDelayTrantion(const NLDMArc* nldmData, double inputTran,
   }
   const NLDMLUT& delayLUT = nldmData->getLUT(delayLUTType);
   const NLDMLUT& transLUT = nldmData->getLUT(transLUTType);
-  delay = delayLUT.value(inputTran, outputLoad);
-  trans = transLUT.value(inputTran, outputLoad);
+  std::vector<const NLDMLUT*> luts = {&delayLUT, &transLUT};
+  std::vector<double> values;
+  lutValues(luts, inputTran, outputLoad, values);
+  delay = values[0];
+  trans = values[1];
   //printf("DEBUG: rise : %s, inTran = %G, outLoad = %G, delay = %G, trans = %G\n", isRise ? "T" : "F", inputTran, outputLoad, delay, trans);
 }
 
@@ -83,10 +95,10 @@ void
 RampVCellDelay::updateLoadCaps()
 {
   size_t rdId = _cellArc->driverResistorId();
-  const std::vector<const Device*>& connDevs = _ckt->traceDevice(rdId);
+  const IndexRange<const Device*>& connDevs = CircuitIndex::tracedDevices(_ckt, rdId);
   for (const Device* dev : connDevs) {
     if (dev->_isInternal && dev->_type == DeviceType::Capacitor) {
-      const std::vector<CellArc*>& arcs = _ckt->cellArcsOfDevice(dev);
+      const IndexRange<const CellArc*>& arcs = CircuitIndex::cellArcsOfDevice(_ckt, dev);
       assert(arcs.empty() == false);
       const CellArc* loadArc = arcs[0];
       Device& mDev = _ckt->device(dev->_devId);
@@ -128,6 +140,11 @@ RampVCellDelay::initParameters()
   updateLoadCaps();
   _effCap =  totalLoadOnDriver(_ckt, _cellArc->driverResistorId());
   markSimulationScope(_cellArc->driverResistorId(), _ckt);
+  _net = RCNet(_ckt, _cellArc->driverSourceId());
+  if (_effCapMode == EffCapMode::PiModel) {
+    /// Load caps are fixed from here on, the model does not include Rd
+    _piModel = PiModel(_ckt, _net, _cellArc->driverResistorId());
+  }
   updateTParams();
   updateRd();
   _tDelta = (_t50-_t20)*10/3;
@@ -242,6 +259,15 @@ effCapCharge(double tDelta, double effCap, double rd, double vdd)
   return vdd * (parenA - parenB) / (rd * tDelta);
 }
 
+/// Derivative of effCapCharge on effCap
+static inline double
+dEffCapCharge(double tDelta, double effCap, double rd, double vdd)
+{
+  double tConstant = effCap * rd;
+  double e = exp(-tDelta/tConstant);
+  return vdd * (tDelta * (1+e) - 2 * tConstant * (1-e)) / tDelta;
+}
+
 void
 RampVCellDelay::updateDriverParameter()
 {
@@ -260,77 +286,141 @@ RampVCellDelay::calcIteration()
   if (_effCap == 0) {
     return false;
   }
-  RootSolver::Function f1 = [this](const Eigen::VectorXd& x)->double {
-    return y(this->_t50, x(0), x(1), _rd, _effCap) - 0.5;
-  };
-  RootSolver::Function f2 = [this](const Eigen::VectorXd& x)->double {
-    double b = delayMatchPoint / 100;
-    return y(this->_t20, x(0), x(1), _rd, _effCap) - b;
-  };
-  RootSolver::Function df1dtz = [this](const Eigen::VectorXd& x)->double {
-    return dydtz(this->_t50, x(0), x(1), _rd, _effCap);
-  };
-  RootSolver::Function df2dtz = [this](const Eigen::VectorXd& x)->double {
-    return dydtz(this->_t20, x(0), x(1), _rd, _effCap);
-  };
-  RootSolver::Function df1dtD = [this](const Eigen::VectorXd& x)->double {
-    return dydtD(this->_t50, x(0), x(1), _rd, _effCap);
+  typedef Eigen::Vector2d Vector2;
+  auto tFunc = [this](const Vector2& x, Vector2& f, Eigen::Matrix2d& jac) {
+    double b = delayMatchFraction();
+    f(0) = y(this->_t50, x(0), x(1), _rd, _effCap) - 0.5;
+    f(1) = y(this->_t20, x(0), x(1), _rd, _effCap) - b;
+    jac(0, 0) = dydtz(this->_t50, x(0), x(1), _rd, _effCap);
+    jac(0, 1) = dydtD(this->_t50, x(0), x(1), _rd, _effCap);
+    jac(1, 0) = dydtz(this->_t20, x(0), x(1), _rd, _effCap);
+    jac(1, 1) = dydtD(this->_t20, x(0), x(1), _rd, _effCap);
   };
-  RootSolver::Function df2dtD = [this](const Eigen::VectorXd& x)->double {
-    return dydtD(this->_t20, x(0), x(1), _rd, _effCap);
+  auto tSolver = makeFixedRootSolver<2>(tFunc);
+  tSolver.setInitX(Vector2(_tZero, _tDelta));
+  bool isConverged = tSolver.run();
+  const Vector2& sol = tSolver.solution();
+  if (setDriverFit(sol(0), sol(1), tSolver.iterCount(), isConverged) == false) {
+    return false;
+  }
+  double vdd = _cellArc->nldmData()->owner()->voltage();
+  double totalCharge = _totalCharge;
+  typedef Eigen::Matrix<double, 1, 1> Vector1;
+  auto cFunc = [this, totalCharge, vdd](const Vector1& x, Vector1& f, Vector1& jac) {
+    f(0) = effCapCharge(this->_tDelta, x(0), _rd, vdd) - totalCharge;
+    jac(0) = dEffCapCharge(this->_tDelta, x(0), _rd, vdd);
   };
-  RootSolver tSolver;
-  tSolver.addFunction(f1);
-  tSolver.addFunction(f2);
-  tSolver.addDerivativeFunction(df1dtz);
-  tSolver.addDerivativeFunction(df1dtD);
-  tSolver.addDerivativeFunction(df2dtz);
-  tSolver.addDerivativeFunction(df2dtD);
-  tSolver.setInitX({_tZero, _tDelta});
-  tSolver.run();
-  const std::vector<double>& sol = tSolver.solution();
-  _tZero = sol[0];
-  _tDelta = sol[1];
+  auto cSolver = makeFixedRootSolver<1>(cFunc);
+  cSolver.setInitX(Vector1(_effCap));
+  isConverged = cSolver.run();
+  return setEffCap(cSolver.solution()(0), cSolver.iterCount(), isConverged);
+}
+
+bool
+RampVCellDelay::setDriverFit(double tZero, double tDelta, size_t iterCount, bool isConverged)
+{
+  _tZero = tZero;
+  _tDelta = tDelta;
   if (Debug::enabled(DebugModule::NLDM)) {
-    printf("DEBUG: new tZero = %G, tDelta = %G solved after %lu iterations\n", _tZero, _tDelta, tSolver.iterCount());
+    printf("DEBUG: new tZero = %G, tDelta = %G solved after %lu iterations\n", _tZero, _tDelta, iterCount);
   }
-  if (std::isnan(_tZero) || std::isnan(_tDelta)) {
+  _isDriverFitted = (isConverged && std::isnan(_tZero) == false && std::isnan(_tDelta) == false);
+  if (_isDriverFitted == false) {
+    printf("WARNING: Ramp driver fit of %s:%s->%s failed after %lu iterations\n", 
+           _cellArc->instance().data(), _cellArc->fromPin().data(), _cellArc->toPin().data(), 
+           _budget.iterCount());
+    _isFallback = true;
     return false;
   }
   updateDriverParameter();
   AnalysisParameter simParam;
   simParam._type = AnalysisType::Tran;
   simParam._simTime = _tDelta * 1.2;
-  simParam._simTick = simParam._simTime / 1000;
+  simParam._simTick = simParam._simTime / 1000 * NetSimulator::stepScale(_intMode, _net);
   simParam._intMethod = IntegrateMethod::Trapezoidal;
-  Simulator sim(*_ckt, simParam);
-  if (Debug::enabled(DebugModule::NLDM)) {
-    printf("DEBUG: start transient simualtion for NLDM calculation\n");
-  }
-  sim.run();
-  const SimResult& simResult = sim.simulationResult();
-  const Device& driverSource = _ckt->device(_cellArc->driverSourceId());
-  double totalCharge = std::abs(simResult.totalCharge(driverSource));
   double vdd = _cellArc->nldmData()->owner()->voltage();
-  RootSolver::Function fEffCap = [this, totalCharge, vdd](const Eigen::VectorXd& x)->double {
-    return effCapCharge(this->_tDelta, x(0), _rd, vdd) - totalCharge;
-  };
-  RootSolver cSolver;
-  cSolver.addFunction(fEffCap);
-  cSolver.setInitX({_effCap});
-  cSolver.run();
-  const std::vector<double>& solvedCap = cSolver.solution();
-  double newEffCap = solvedCap[0];
+  if (_piModel.isValid()) {
+    _totalCharge = _piModel.rampCharge(_rd, _tDelta, vdd, simParam._simTime);
+  } else {
+    if (Debug::enabled(DebugModule::NLDM)) {
+      printf("DEBUG: start transient simualtion for NLDM calculation\n");
+    }
+    NetSimulator sim(*_ckt, _net, simParam);
+    sim.setIntegrateMode(_intMode);
+    sim.setCompactWaveforms(_isCompact);
+    /// Only the source charge is used, record the driver output for result()
+    sim.recordNode(_cellArc->outputNode(_ckt));
+    sim.run();
+    _totalCharge = std::abs(sim.simulationResult().totalCharge());
+    _lastResult = sim.releaseResult();
+  }
+  return true;
+}
+
+bool
+RampVCellDelay::setEffCap(double newEffCap, size_t iterCount, bool isConverged)
+{
+  trace<TraceModule::NLDM>(TraceEvent::EffCapIteration, iterCount, newEffCap, _totalCharge);
   if (Debug::enabled(DebugModule::NLDM)) {
-    printf("DEBUG: new effCap calculated to be %G with total charge of %G in %lu iterations\n", newEffCap, totalCharge, cSolver.iterCount());
+    printf("DEBUG: new effCap calculated to be %G with total charge of %G in %lu iterations\n", newEffCap, _totalCharge, iterCount);
+  }
+  if (isConverged == false || std::isnan(newEffCap)) {
+    printf("WARNING: Effective cap fit of %s:%s->%s failed after %lu iterations\n", 
+           _cellArc->instance().data(), _cellArc->fromPin().data(), _cellArc->toPin().data(), 
+           _budget.iterCount());
+    _isFallback = true;
+    return false;
   }
   double absDiff = std::abs((newEffCap - _effCap)/_effCap);
+  double relaxedEffCap = _budget.relax(_effCap, newEffCap);
+  _budget.update(std::vector<double>(1, relaxedEffCap));
   if (absDiff < 0.001) {
-    _finalResult.copy(simResult);
+    _finalResult = std::move(_lastResult);
     return false;
-  } else {
-    _effCap = newEffCap;
-    return true;
+  }
+  if (_budget.isExhausted()) {
+    printf("WARNING: Effective cap of %s:%s->%s %s after %lu iterations in %G seconds\n", 
+           _cellArc->instance().data(), _cellArc->fromPin().data(), _cellArc->toPin().data(), 
+           _budget.isDiverged() ? "diverged" : "is out of budget", _budget.iterCount(), _budget.iterSeconds());
+    _isFallback = true;
+    return false;
+  }
+  _effCap = relaxedEffCap;
+  return true;
+}
+
+void
+RampVCellDelay::updateIteration()
+{
+  updateDriverParameter();
+  updateTParams();
+  updateRd();
+  if (Debug::enabled(DebugModule::NLDM)) {
+    printf("DEBUG: T50 updated to %G, output transition to %G, T20 to %G, Rd to %G\n", 
+           _t50, _driverPinTran, _t20, _rd);
+  }
+}
+
+void
+RampVCellDelay::addDriverFit(RampVFitBatch& batch) const
+{
+  batch.addDriverFit(_t50, _t20, _rd, _effCap, _tZero, _tDelta);
+}
+
+void
+RampVCellDelay::addEffCapFit(RampVFitBatch& batch) const
+{
+  double vdd = _cellArc->nldmData()->owner()->voltage();
+  batch.addEffCapFit(_tDelta, _rd, vdd, _totalCharge, _effCap);
+}
+
+void
+RampVCellDelay::applyToCircuit()
+{
+  updateLoadCaps();
+  markSimulationScope(_cellArc->driverResistorId(), _ckt);
+  if (_isDriverFitted) {
+    updateDriverParameter();
   }
 }
 
@@ -343,15 +433,9 @@ RampVCellDelay::calculate()
   }
   initParameters();
   while (calcIteration()) {
-    updateDriverParameter();
-    updateTParams();
-    updateRd();
-    if (Debug::enabled(DebugModule::NLDM)) {
-      printf("DEBUG: T50 updated to %G, output transition to %G, T20 to %G, Rd to %G\n", 
-             _t50, _driverPinTran, _t20, _rd);
-    }
+    updateIteration();
   }
-  return true;
+  return _isFallback == false;
 }
 
 
@@ -3,7 +3,12 @@
 
 #include "Circuit.h"
 #include "LibData.h"
-#include "SimResult.h"
+#include "RCNet.h"
+#include "NetSimulator.h"
+#include "PiModel.h"
+#include "DelayOptions.h"
+#include "RampVFitBatch.h"
+#include "IterationBudget.h"
 
 namespace NA {
 
@@ -15,20 +20,45 @@ class RampVCellDelay {
     RampVCellDelay(const CellArc* cellArc, Circuit* ckt)
     : _cellArc(cellArc), _ckt(ckt), _libData(cellArc->nldmData()->owner()) {}
 
+    /// Returns false if the arc falls back to the NLDM estimation, see isFallback
     bool calculate();
 
     double tZero() const { return _tZero; }
     double tDelta() const { return _tDelta; }
     double Rd() const { return _rd; }
     double effCap() const { return _effCap; }
-    SimResult result() const { return _finalResult; }
+    /// Empty if the effective cap is calculated with the pi model
+    const NetSimResult& result() const { return _finalResult; }
+    void clearResult() { _finalResult.clear(); _lastResult.clear(); }
     bool isRiseOnOutputPin() const { return _isRiseOnDriverPin; }
 
     void setInputTransition(double inputTran) { _inputTran = inputTran; }
     void setIsInputTranRise(bool isRise) { _isRiseOnInputPin = isRise; }
+    void setEffCapMode(EffCapMode mode) { _effCapMode = mode; }
+    void setIntegrateMode(IntegrateMode mode) { _intMode = mode; }
+    void setCompactWaveforms(bool isCompact) { _isCompact = isCompact; }
+    void setBudget(size_t maxIterations, double maxSeconds) { _budget = IterationBudget(maxIterations, maxSeconds); }
+    const IterationBudget& budget() const { return _budget; }
+    /// The driver fit failed or the effective cap did not converge within the budget,
+    /// the arc is reported with the NLDM estimation
+    bool isFallback() const { return _isFallback; }
 
-  private:
+    /// Steps of calculate(), used to fit the drivers of many arcs in one batch:
+    /// initParameters, then while the effective cap changes, addDriverFit,
+    /// setDriverFit with the batch solution, addEffCapFit, setEffCap and updateIteration.
+    /// Solutions that are not converged send the arc to the NLDM fallback.
+    /// Arcs may share circuit devices, applyToCircuit sets the devices
+    /// back to this arc before it is simulated.
     void initParameters();
+    void addDriverFit(RampVFitBatch& batch) const;
+    bool setDriverFit(double tZero, double tDelta, size_t iterCount, bool isConverged);
+    void addEffCapFit(RampVFitBatch& batch) const;
+    bool setEffCap(double newEffCap, size_t iterCount, bool isConverged);
+    void updateIteration();
+    void applyToCircuit();
+    static double delayMatchFraction();
+
+  private:
     void updateParameters();
     double extrapolateDelayTime(double t50, double trans, double targetThres) const;
     void updateTParams();
@@ -41,7 +71,17 @@ class RampVCellDelay {
     const CellArc* _cellArc;
     Circuit* _ckt;
     const LibData* _libData;
-    SimResult _finalResult;
+    RCNet _net;
+    PiModel _piModel;
+    EffCapMode _effCapMode = EffCapMode::Transient;
+    IntegrateMode _intMode = IntegrateMode::Default;
+    bool _isCompact = false;
+    IterationBudget _budget;
+    bool _isFallback = false;
+    NetSimResult _finalResult;
+    NetSimResult _lastResult;
+    double _totalCharge = 0;
+    bool   _isDriverFitted = false;
     bool   _isRiseOnInputPin = true;
     bool   _isRiseOnDriverPin = true;
     bool   _setTerminationCondition = false;
@@ -58,6 +98,10 @@ class RampVCellDelay {
     double _t20 = 0;
 };
 
+void calcNLDMLUTDelayTrantion(const NLDMArc* nldmData, double inputTran, 
+                              double outputLoad, bool isRise, 
+                              double& delay, double& trans);
+
 }
 
 #endif
@@ -1,15 +1,25 @@
 #include <cassert>
+#include <algorithm>
 #include "RampVDelay.h"
 #include "RampVCellDelay.h"
-#include "Simulator.h"
+#include "RampVFitBatch.h"
+#include "CircuitIndex.h"
+#include "ShardRunner.h"
+#include "ArcArena.h"
+#include "ArcEstimate.h"
+#include "IterationBudget.h"
+#include "Checkpoint.h"
+#include "NetSimulator.h"
+#include "RCNet.h"
 #include "Debug.h"
 #include "Plotter.h"
 #include "CommonUtils.h"
 
 namespace NA {
 
-RampVDelay::RampVDelay(const AnalysisParameter& param, const NetlistParser& parser)
-: _ckt(parser, param)
+RampVDelay::RampVDelay(const AnalysisParameter& param, const NetlistParser& parser, 
+                       const DelayOptions& options)
+: _ckt(parser, param), _options(options)
 {
   const std::vector<std::string>& pinsToCalc = parser.cellOutPinsToCalcDelay();
   for (const std::string& outPin : pinsToCalc) {
@@ -23,69 +33,343 @@ RampVDelay::RampVDelay(const AnalysisParameter& param, const NetlistParser& pars
       _cellArcs.push_back(driverArc);
     }
   }
+  std::vector<size_t> driverDevIds;
+  for (const CellArc* driverArc : _cellArcs) {
+    driverDevIds.push_back(driverArc->driverSourceId());
+    driverDevIds.push_back(driverArc->driverResistorId());
+  }
+  CircuitIndex::build(&_ckt, driverDevIds);
+  _isInShard = ShardRunner::shardMask(&_ckt, _cellArcs, _options);
+  ShardRunner::beginSection(_options);
+  Checkpoint::beginSection();
+}
+
+RampVDelay::~RampVDelay()
+{
+  CircuitIndex::clear(&_ckt);
 }
 
+/// Arcs are fitted, simulated and reported one at a time, so that results
+/// are streamed out and only the data of one arc is kept in memory.
+/// Batch fitting needs all arcs, their simulation results are released
+/// once the arc is reported.
 void
 RampVDelay::calculate()
 {
-  for (const CellArc* driverArc : _cellArcs) {
-    calculateArc(driverArc);
+  if (_options._isCrosstalk) {
+    calculateCrosstalk();
+    return;
+  }
+  if (_options._batchFit == false) {
+    for (size_t i=0; i<_cellArcs.size(); ++i) {
+      if (_isInShard[i] == false) {
+        continue;
+      }
+      ShardRunner::beginArc(_options, i);
+      if (Checkpoint::restoreArc(i, _cellArcs[i])) {
+        continue;
+      }
+      Checkpoint::beginArc(i, _cellArcs[i]);
+      ArcArena arena;
+      RampVCellDelay cellDelayCalc(_cellArcs[i], &_ckt);
+      cellDelayCalc.setEffCapMode(_options._effCapMode);
+      cellDelayCalc.setIntegrateMode(_options._integrateMode);
+      cellDelayCalc.setCompactWaveforms(_options._compactWaveforms);
+      cellDelayCalc.setBudget(_options._maxIterations, _options._maxArcSeconds);
+      cellDelayCalc.calculate();
+      calculateArc(_cellArcs[i], cellDelayCalc);
+      Checkpoint::endArc();
+    }
+    return;
+  }
+  std::vector<RampVCellDelay> cellDelayCalcs;
+  cellDelayCalcs.reserve(_cellArcs.size());
+  for (size_t i=0; i<_cellArcs.size(); ++i) {
+    if (_isInShard[i] == false || Checkpoint::isFinished(i, _cellArcs[i])) {
+      continue;
+    }
+    cellDelayCalcs.push_back(RampVCellDelay(_cellArcs[i], &_ckt));
+    cellDelayCalcs.back().setEffCapMode(_options._effCapMode);
+    cellDelayCalcs.back().setIntegrateMode(_options._integrateMode);
+    cellDelayCalcs.back().setCompactWaveforms(_options._compactWaveforms);
+    /// Time budgets of batch fitting start with the batch
+    cellDelayCalcs.back().setBudget(_options._maxIterations, _options._maxArcSeconds);
+  }
+  fitBatch(cellDelayCalcs);
+  size_t k = 0;
+  for (size_t i=0; i<_cellArcs.size(); ++i) {
+    if (_isInShard[i] == false) {
+      continue;
+    }
+    ShardRunner::beginArc(_options, i);
+    if (Checkpoint::restoreArc(i, _cellArcs[i])) {
+      continue;
+    }
+    Checkpoint::beginArc(i, _cellArcs[i]);
+    ArcArena arena;
+    cellDelayCalcs[k].applyToCircuit();
+    calculateArc(_cellArcs[i], cellDelayCalcs[k]);
+    cellDelayCalcs[k].clearResult();
+    Checkpoint::endArc();
+    ++k;
   }
 }
 
+/// Same iterations as RampVCellDelay::calculate, with the Newton solves 
+/// of all arcs done together. Charges are still calculated arc by arc,
+/// as arcs may share devices of the circuit.
 void
-RampVDelay::calculateArc(const CellArc* driverArc)
+RampVDelay::fitBatch(std::vector<RampVCellDelay>& cellDelayCalcs)
 {
-  RampVCellDelay cellDelayCalc(driverArc, &_ckt);
-  cellDelayCalc.calculate();
-  if (Debug::enabled(DebugModule::NLDM)) {
-    printf("DEBUG: Starting network simulation for net arc delay calculation\n");
+  std::vector<RampVCellDelay*> active;
+  for (RampVCellDelay& cellDelayCalc : cellDelayCalcs) {
+    cellDelayCalc.initParameters();
+    if (cellDelayCalc.effCap() != 0) {
+      active.push_back(&cellDelayCalc);
+    }
   }
-  double tOffset = cellDelayCalc.tZero();
-  AnalysisParameter simParam;
-  simParam._name = "fd";
-  simParam._type = AnalysisType::Tran;
-  simParam._simTime = 1e99;
-  simParam._simTick = cellDelayCalc.tDelta() / 1000;
-  simParam._intMethod = IntegrateMethod::Trapezoidal;
-  Simulator sim(_ckt, simParam);
-  const std::vector<const CellArc*>& loadArcs = setTerminationCondition(&_ckt, driverArc, cellDelayCalc.isRiseOnOutputPin(), sim);
-  sim.run();
-  const SimResult& simResult = sim.simulationResult();
+  while (active.empty() == false) {
+    RampVFitBatch driverBatch;
+    for (const RampVCellDelay* cellDelayCalc : active) {
+      cellDelayCalc->addDriverFit(driverBatch);
+    }
+    driverBatch.solve(RampVCellDelay::delayMatchFraction());
+    std::vector<RampVCellDelay*> fitted;
+    for (size_t i=0; i<active.size(); ++i) {
+      ArcArena arena;
+      active[i]->applyToCircuit();
+      if (active[i]->setDriverFit(driverBatch.tZero(i), driverBatch.tDelta(i), 
+                                  driverBatch.iterCount(), driverBatch.isConverged(i))) {
+        fitted.push_back(active[i]);
+      }
+    }
+    RampVFitBatch effCapBatch;
+    for (const RampVCellDelay* cellDelayCalc : fitted) {
+      cellDelayCalc->addEffCapFit(effCapBatch);
+    }
+    effCapBatch.solve(RampVCellDelay::delayMatchFraction());
+    active.clear();
+    for (size_t i=0; i<fitted.size(); ++i) {
+      if (fitted[i]->setEffCap(effCapBatch.effCap(i), effCapBatch.iterCount(), 
+                               effCapBatch.isConverged(i))) {
+        fitted[i]->updateIteration();
+        active.push_back(fitted[i]);
+      }
+    }
+    if (Debug::enabled(DebugModule::NLDM)) {
+      printf("DEBUG: Batch driver fit of %lu arcs, %lu arcs to iterate\n", 
+             driverBatch.size(), active.size());
+    }
+  }
+}
+
+/// Every arc is fitted first, so that the driver of each net can switch
+/// as an aggressor with its own ramp and driver resistance. Each net is
+/// reported with quiet aggressors, then simulated with its aggressors aligned
+/// at each offset of the window around its own driver ramp.
+/// All aggressors of a net are moved together. Offsets only change the
+/// aggressor sources, the factorization of the net matrix is reused.
+void
+RampVDelay::calculateCrosstalk()
+{
+  std::vector<RampVCellDelay> cellDelayCalcs;
+  cellDelayCalcs.reserve(_cellArcs.size());
+  for (const CellArc* driverArc : _cellArcs) {
+    cellDelayCalcs.push_back(RampVCellDelay(driverArc, &_ckt));
+    cellDelayCalcs.back().setEffCapMode(_options._effCapMode);
+    cellDelayCalcs.back().setIntegrateMode(_options._integrateMode);
+    cellDelayCalcs.back().setCompactWaveforms(_options._compactWaveforms);
+    cellDelayCalcs.back().setBudget(_options._maxIterations, _options._maxArcSeconds);
+  }
+  if (_options._batchFit) {
+    fitBatch(cellDelayCalcs);
+  } else {
+    for (RampVCellDelay& cellDelayCalc : cellDelayCalcs) {
+      ArcArena arena;
+      cellDelayCalc.calculate();
+    }
+  }
+  /// Driver source of each arc, aggressors switch with the first arc of their source
+  std::unordered_map<size_t, size_t> sourceArcs;
+  for (size_t i=0; i<_cellArcs.size(); ++i) {
+    if (cellDelayCalcs[i].isFallback() == false) {
+      sourceArcs.insert({_cellArcs[i]->driverSourceId(), i});
+    }
+    cellDelayCalcs[i].clearResult();
+  }
+  size_t alignCount = std::max(_options._crosstalkAlignments, static_cast<size_t>(1));
+  for (size_t i=0; i<_cellArcs.size(); ++i) {
+    if (_isInShard[i] == false) {
+      continue;
+    }
+    const CellArc* driverArc = _cellArcs[i];
+    ShardRunner::beginArc(_options, i);
+    if (Checkpoint::restoreArc(i, driverArc)) {
+      continue;
+    }
+    Checkpoint::beginArc(i, driverArc);
+    ArcArena arena;
+    RampVCellDelay& victim = cellDelayCalcs[i];
+    /// Aggressors centered on the victim ramp at offset 0
+    std::unordered_map<size_t, double> centerOffsets;
+    RCNet net(&_ckt, driverArc->driverSourceId(), true);
+    for (const RCNet::Aggressor& aggressor : net.aggressors()) {
+      const auto& found = sourceArcs.find(aggressor._srcDevId);
+      if (found != sourceArcs.end()) {
+        RampVCellDelay& aggressorCalc = cellDelayCalcs[found->second];
+        aggressorCalc.applyToCircuit();
+        centerOffsets[aggressor._srcDevId] = (victim.tDelta() - aggressorCalc.tDelta()) / 2;
+      }
+    }
+    victim.applyToCircuit();
+    ArcDelays quietDelays;
+    calculateArc(driverArc, victim, &quietDelays);
+    if (quietDelays._isValid == false || centerOffsets.empty()) {
+      Checkpoint::endArc();
+      continue;
+    }
+    double window = _options._crosstalkWindow > 0 ? _options._crosstalkWindow : victim.tDelta();
+    ArcDelays worstDelays;
+    double worstArrival = 0;
+    double worstOffset = 0;
+    std::vector<const CellArc*> loadArcs;
+    for (size_t k=0; k<alignCount; ++k) {
+      double offset = (alignCount == 1) ? 0 : window * (2.0 * k / (alignCount - 1) - 1);
+      std::unordered_map<size_t, double> aggressorOffsets;
+      for (const auto& kv : centerOffsets) {
+        aggressorOffsets[kv.first] = kv.second + offset;
+      }
+      const ArcDelays& delays = simulateArc(driverArc, victim, aggressorOffsets, loadArcs);
+      double arrival = delays._cellDelay;
+      if (delays._netDelays.empty() == false) {
+        arrival += *std::max_element(delays._netDelays.begin(), delays._netDelays.end());
+      }
+      if (worstDelays._isValid == false || arrival > worstArrival) {
+        worstDelays = delays;
+        worstArrival = arrival;
+        worstOffset = offset;
+      }
+    }
+    Checkpoint::report("Crosstalk cell delay of %s:%s->%s: %G, delta %G, transition on output pin: %G, aggressor offset %G\n", 
+                       driverArc->instance().data(), driverArc->fromPin().data(), driverArc->toPin().data(), 
+                       worstDelays._cellDelay, worstDelays._cellDelay - quietDelays._cellDelay, 
+                       worstDelays._cellTran, worstOffset);
+    for (size_t j=0; j<loadArcs.size() && j<quietDelays._netDelays.size(); ++j) {
+      const CellArc* loadArc = loadArcs[j];
+      Checkpoint::report("Crosstalk net delay of %s->%s: %G, delta %G, transition on %s: %G\n", 
+                         driverArc->toPinFullName().data(), loadArc->fromPinFullName().data(), 
+                         worstDelays._netDelays[j], worstDelays._netDelays[j] - quietDelays._netDelays[j], 
+                         loadArc->fromPinFullName().data(), worstDelays._loadTrans[j]);
+    }
+    fflush(stdout);
+    Checkpoint::endArc();
+  }
+}
+
+static RampVDelay::ArcDelays
+measureArcDelays(const Circuit* ckt, const CellArc* driverArc, double tOffset, 
+                 const NetSimResult& simResult, const std::vector<const CellArc*>& loadArcs)
+{
+  RampVDelay::ArcDelays delays;
   const LibData* libData = driverArc->libData();
   //const Device& inputSrc = _ckt.device(driverArc->inputSourceDevId(&_ckt));
   size_t inputNodeId = driverArc->inputNode();
   double inputT50;
   double inputTran;
   measureVoltage(simResult, inputNodeId, libData, inputT50, inputTran);
-  size_t outputNodeId = driverArc->outputNode(&_ckt);
+  size_t outputNodeId = driverArc->outputNode(ckt);
   double outputT50;
-  double outputTran;
-  measureVoltage(simResult, outputNodeId, libData, outputT50, outputTran);
-  double cellDelay = outputT50 - inputT50 + tOffset;
-  printf("Cell delay of %s:%s->%s: %G, transition on output pin: %G\n", driverArc->instance().data(), driverArc->fromPin().data(), 
-          driverArc->toPin().data(), cellDelay, outputTran);
+  measureVoltage(simResult, outputNodeId, libData, outputT50, delays._cellTran);
+  delays._cellDelay = outputT50 - inputT50 + tOffset;
   if (Debug::enabled(DebugModule::NLDM)) {
-    PlotData cellArcPlotData;
-    cellArcPlotData._canvasName = "Cell Delay";
-    populatePlotData(cellArcPlotData, driverArc->inputNode(), driverArc->outputNode(&_ckt), &_ckt);
-    Plotter::plot(cellArcPlotData, {_ckt}, {simResult});
+    plotArcWaveforms("Cell Delay", driverArc->inputNode(), driverArc->outputNode(ckt), simResult);
   }
   for (const CellArc* loadArc : loadArcs) {
     size_t loadNode = loadArc->inputNode();
     double loadT50;
     double loadTran;
     measureVoltage(simResult, loadNode, loadArc->libData(), loadT50, loadTran);
-    double netDelay = loadT50 - outputT50;
-    printf("Net delay of %s->%s: %G, transition on %s: %G\n", driverArc->toPinFullName().data(), 
-           loadArc->fromPinFullName().data(), netDelay, loadArc->fromPinFullName().data(), loadTran);
+    delays._netDelays.push_back(loadT50 - outputT50);
+    delays._loadTrans.push_back(loadTran);
     if (Debug::enabled(DebugModule::NLDM)) {
-      PlotData netArcPlotData;
-      netArcPlotData._canvasName = "Net Delay";
-      populatePlotData(netArcPlotData, driverArc->outputNode(&_ckt), loadArc->inputNode(), &_ckt);
-      Plotter::plot(netArcPlotData, {_ckt}, {simResult});
+      plotArcWaveforms("Net Delay", driverArc->outputNode(ckt), loadArc->inputNode(), simResult);
     }
   }
+  delays._isValid = true;
+  return delays;
+}
+
+static void
+reportArcDelays(const CellArc* driverArc, const std::vector<const CellArc*>& loadArcs, 
+                const RampVDelay::ArcDelays& delays)
+{
+  Checkpoint::report("Cell delay of %s:%s->%s: %G, transition on output pin: %G\n", driverArc->instance().data(), driverArc->fromPin().data(), 
+          driverArc->toPin().data(), delays._cellDelay, delays._cellTran);
+  for (size_t i=0; i<loadArcs.size(); ++i) {
+    const CellArc* loadArc = loadArcs[i];
+    Checkpoint::report("Net delay of %s->%s: %G, transition on %s: %G\n", driverArc->toPinFullName().data(), 
+           loadArc->fromPinFullName().data(), delays._netDelays[i], loadArc->fromPinFullName().data(), delays._loadTrans[i]);
+  }
+  /// Results are visible as soon as the arc is done when the output is redirected
+  fflush(stdout);
+}
+
+RampVDelay::ArcDelays
+RampVDelay::simulateArc(const CellArc* driverArc, const RampVCellDelay& cellDelayCalc, 
+                        const std::unordered_map<size_t, double>& aggressorOffsets, 
+                        std::vector<const CellArc*>& loadArcs)
+{
+  if (Debug::enabled(DebugModule::NLDM)) {
+    printf("DEBUG: Starting network simulation for net arc delay calculation\n");
+  }
+  double tOffset = cellDelayCalc.tZero();
+  /// Coupled nets keep the general Simulator without crosstalk analysis
+  RCNet net(&_ckt, driverArc->driverSourceId(), _options._isCrosstalk);
+  AnalysisParameter simParam;
+  simParam._name = "fd";
+  simParam._type = AnalysisType::Tran;
+  simParam._simTime = 1e99;
+  simParam._simTick = cellDelayCalc.tDelta() / 1000 * NetSimulator::stepScale(_options._integrateMode, net);
+  simParam._intMethod = IntegrateMethod::Trapezoidal;
+  NetSimulator sim(_ckt, net, simParam);
+  sim.setIntegrateMode(_options._integrateMode);
+  sim.setCompactWaveforms(_options._compactWaveforms);
+  for (const auto& kv : aggressorOffsets) {
+    sim.setAggressorOffset(kv.first, kv.second);
+  }
+  loadArcs = setTerminationCondition(&_ckt, driverArc, cellDelayCalc.isRiseOnOutputPin(), sim);
+  sim.addStimulus(driverArc->inputSourceDevId(&_ckt));
+  recordArcNodes(&_ckt, driverArc, loadArcs, cellDelayCalc.isRiseOnOutputPin(), sim);
+  terminateAtArcCrossings(&_ckt, driverArc, loadArcs, sim);
+  sim.run();
+  ArcDelays delays = measureArcDelays(&_ckt, driverArc, tOffset, sim.simulationResult(), loadArcs);
+  delays._simTime = sim.simulationResult().currentTime();
+  delays._simSteps = sim.simulationResult().stepCount();
+  return delays;
+}
+
+void
+RampVDelay::calculateArc(const CellArc* driverArc, RampVCellDelay& cellDelayCalc, ArcDelays* delays)
+{
+  if (_options._reportIterations) {
+    reportArcIterations(driverArc, cellDelayCalc.budget(), cellDelayCalc.isFallback() == false);
+  }
+  if (cellDelayCalc.isFallback()) {
+    reportArcEstimate(driverArc, estimateArc(&_ckt, driverArc, true), " [fallback: nldm]");
+    fflush(stdout);
+    return;
+  }
+  std::vector<const CellArc*> loadArcs;
+  const ArcDelays& arcDelays = simulateArc(driverArc, cellDelayCalc, 
+                                           std::unordered_map<size_t, double>(), loadArcs);
+  if (_options._reportIterations) {
+    Checkpoint::report("Net simulation of %s: simulated to %G in %lu steps\n", 
+                       driverArc->toPinFullName().data(), arcDelays._simTime, arcDelays._simSteps);
+  }
+  reportArcDelays(driverArc, loadArcs, arcDelays);
+  if (delays != nullptr) {
+    *delays = arcDelays;
+  }
 }
 
 
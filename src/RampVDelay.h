@@ -3,24 +3,53 @@
 
 #include <tuple>
 #include <vector>
+#include <unordered_map>
 #include "Base.h"
 #include "NetlistParser.h"
 #include "Circuit.h"
+#include "DelayOptions.h"
+#include "RampVCellDelay.h"
 
 namespace NA {
 
 class RampVDelay {
   public:
-    RampVDelay(const AnalysisParameter& param, const NetlistParser& parser);
+    RampVDelay(const AnalysisParameter& param, const NetlistParser& parser, 
+               const DelayOptions& options);
+    ~RampVDelay();
 
     void calculate();
 
+    /// Delays measured on the net simulation of an arc
+    struct ArcDelays {
+      bool                _isValid = false;
+      double              _cellDelay = 0;
+      double              _cellTran = 0;
+      std::vector<double> _netDelays;
+      std::vector<double> _loadTrans;
+      /// End time and step count of the net simulation
+      double              _simTime = 0;
+      size_t              _simSteps = 0;
+    };
+
   private:
-    void calculateArc(const CellArc* driverArc);
+    void fitBatch(std::vector<RampVCellDelay>& cellDelayCalcs);
+    void calculateCrosstalk();
+    /// Fills delays if the arc is not reported with the NLDM fallback
+    void calculateArc(const CellArc* driverArc, RampVCellDelay& cellDelayCalc, 
+                      ArcDelays* delays = nullptr);
+    /// Aggressors of the net switch with the offsets of their driver sources,
+    /// aggressors without an offset are quiet
+    ArcDelays simulateArc(const CellArc* driverArc, const RampVCellDelay& cellDelayCalc, 
+                          const std::unordered_map<size_t, double>& aggressorOffsets, 
+                          std::vector<const CellArc*>& loadArcs);
 
   private:
     Circuit _ckt;
+    DelayOptions _options;
     std::vector<const CellArc*> _cellArcs;
+    /// Arcs calculated by this process, see ShardRunner
+    std::vector<bool> _isInShard;
 
 };
 
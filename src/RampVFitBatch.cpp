@@ -0,0 +1,273 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "RampVFitBatch.h"
+
+/// The lane loops are also built for x86-64-v3, AVX2 and FMA, and that
+/// build is picked when the program is loaded on a CPU that has them. The
+/// default x86-64 build has SSE2 vectors of only 2 lanes, and gains little
+/// over scalar code. The lane helpers are always inlined, so that they are
+/// built for each clone of the loops.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define NA_LANE_CLONES __attribute__((target_clones("arch=x86-64-v3", "default")))
+#define NA_LANE_INLINE __attribute__((always_inline))
+#else
+#define NA_LANE_CLONES
+#define NA_LANE_INLINE
+#endif
+
+namespace NA {
+
+size_t
+RampVFitBatch::addDriverFit(double t50, double t20, double rd, double effCap, 
+                            double tZero, double tDelta)
+{
+  _isDriverFit = true;
+  _t50.push_back(t50);
+  _t20.push_back(t20);
+  _tConstant.push_back(rd * effCap);
+  _x1.push_back(tZero);
+  _x2.push_back(tDelta);
+  return _x1.size() - 1;
+}
+
+size_t
+RampVFitBatch::addEffCapFit(double tDelta, double rd, double vdd, 
+                            double charge, double effCap)
+{
+  _isDriverFit = false;
+  _tDelta.push_back(tDelta);
+  _rd.push_back(rd);
+  _vdd.push_back(vdd);
+  _charge.push_back(charge);
+  _x1.push_back(effCap);
+  _x2.push_back(0);
+  return _x1.size() - 1;
+}
+
+/// a if the sign bit of d is set, otherwise b, selected in the bits.
+/// Both values are used, so the compiler can not move their calculation
+/// under a branch, and NaN or inf of the value not selected do not leak
+/// into the result. The mask is taken from the sign with a logical shift,
+/// a comparison would give a boolean the vectorizer can not widen to 64
+/// bits without SSE4.
+NA_LANE_INLINE static inline double
+laneSelect(double d, double a, double b)
+{
+  uint64_t dBits;
+  uint64_t aBits;
+  uint64_t bBits;
+  memcpy(&dBits, &d, sizeof(dBits));
+  memcpy(&aBits, &a, sizeof(aBits));
+  memcpy(&bBits, &b, sizeof(bBits));
+  uint64_t mask = 0 - (dBits >> 63);
+  uint64_t bits = (aBits & mask) | (bBits & ~mask);
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/// exp without branches or library calls, so that the lane loops vectorize.
+/// x = k*ln2 + r with |r| <= ln2/2, exp(r) is summed to r^13 and 2^k is
+/// built in the exponent bits. Results are within 2 ulp of std::exp for x
+/// in [-708, 709], 0 below -708. Larger x are not supported, the lanes only
+/// take exponentials of negative numbers.
+NA_LANE_INLINE static inline double
+laneExp(double x)
+{
+  static const double shifter = 6755399441055744.0;
+  /// k is rounded by adding 1.5*2^52, it is then in the low bits of kd
+  double kd = x * 1.4426950408889634 + shifter;
+  uint64_t kBits;
+  memcpy(&kBits, &kd, sizeof(kBits));
+  kd -= shifter;
+  double r = x - kd * 6.93147180369123816490e-01 - kd * 1.90821492927058770002e-10;
+  double p = 1.0 / 6227020800.0;
+  p = p * r + 1.0 / 479001600.0;
+  p = p * r + 1.0 / 39916800.0;
+  p = p * r + 1.0 / 3628800.0;
+  p = p * r + 1.0 / 362880.0;
+  p = p * r + 1.0 / 40320.0;
+  p = p * r + 1.0 / 5040.0;
+  p = p * r + 1.0 / 720.0;
+  p = p * r + 1.0 / 120.0;
+  p = p * r + 1.0 / 24.0;
+  p = p * r + 1.0 / 6.0;
+  p = p * r + 0.5;
+  p = p * r + 1.0;
+  p = p * r + 1.0;
+  uint64_t scaleBits = (kBits << 52) + 0x3ff0000000000000ULL;
+  double scale;
+  memcpy(&scale, &scaleBits, sizeof(scale));
+  /// A clamp of x would be a branch, underflow is selected in the bits
+  return laneSelect(x + 708.0, 0.0, p * scale);
+}
+
+/// Ramp output y and its derivatives on tZero and tDelta at time t,
+/// without branching on the ramp region. Both exponentials are shared
+/// by the value and the derivatives, and the divisions by tConstant and
+/// tDelta are taken as products with their reciprocals, which are the
+/// same for both points of a lane.
+NA_LANE_INLINE static inline void
+rampPoint(double t, double tZero, double tDelta, double tConstant,
+          double invTConstant, double invTDelta,
+          double& y, double& dydtz, double& dydtD)
+{
+  double tShift = t - tZero;
+  /// Negative in the ramp region, tShift < tDelta
+  double rampSign = tShift - tDelta;
+  /// max(tShift, 0) and max(tShift - tDelta, 0)
+  double s1 = laneSelect(tShift, 0.0, tShift);
+  double s2 = laneSelect(rampSign, 0.0, rampSign);
+  double e1 = laneExp(-s1 * invTConstant);
+  double e2 = laneExp(-s2 * invTConstant);
+  double y0a = s1 - tConstant * (1 - e1);
+  double y0b = s2 - tConstant * (1 - e2);
+  double tmtD = t - tDelta;
+  y = (y0a - y0b) * invTDelta;
+  /// Both regions are calculated and selected, divisions under a
+  /// condition would keep the loop from being vectorized
+  double rampDydtD = -y0a * invTDelta * invTDelta;
+  dydtz = laneSelect(rampSign, (e1 - 1) * invTDelta, e1 - e2);
+  dydtD = laneSelect(rampSign, rampDydtD, rampDydtD - y0b / (tmtD * tmtD));
+}
+
+/// Lanes are passed as restrict pointers, the arrays never overlap
+NA_LANE_CLONES static void
+evaluateDriverFit(size_t n, const double* __restrict__ x1, const double* __restrict__ x2,
+                  const double* __restrict__ t50, const double* __restrict__ t20,
+                  const double* __restrict__ tConstant, double delayMatch,
+                  double* __restrict__ f1, double* __restrict__ f2,
+                  double* __restrict__ j11, double* __restrict__ j12,
+                  double* __restrict__ j21, double* __restrict__ j22)
+{
+  for (size_t i=0; i<n; ++i) {
+    double invTConstant = 1 / tConstant[i];
+    double invTDelta = 1 / x2[i];
+    double y1, dy1dtz, dy1dtD;
+    double y2, dy2dtz, dy2dtD;
+    rampPoint(t50[i], x1[i], x2[i], tConstant[i], invTConstant, invTDelta, 
+              y1, dy1dtz, dy1dtD);
+    rampPoint(t20[i], x1[i], x2[i], tConstant[i], invTConstant, invTDelta, 
+              y2, dy2dtz, dy2dtD);
+    f1[i] = y1 - 0.5;
+    f2[i] = y2 - delayMatch;
+    j11[i] = dy1dtz;
+    j12[i] = dy1dtD;
+    j21[i] = dy2dtz;
+    j22[i] = dy2dtD;
+  }
+}
+
+/// Same as effCapCharge and its derivative in RampVCellDelay,
+/// the second unknown is unused and kept at 0
+NA_LANE_CLONES static void
+evaluateEffCapFit(size_t n, const double* __restrict__ x1, 
+                  const double* __restrict__ tDeltas, const double* __restrict__ rd,
+                  const double* __restrict__ vdd, const double* __restrict__ charges,
+                  double* __restrict__ f1, double* __restrict__ f2,
+                  double* __restrict__ j11, double* __restrict__ j12,
+                  double* __restrict__ j21, double* __restrict__ j22)
+{
+  for (size_t i=0; i<n; ++i) {
+    double tDelta = tDeltas[i];
+    double tConstant = x1[i] * rd[i];
+    double e = laneExp(-tDelta / tConstant);
+    double charge = tConstant * tDelta - tConstant * tConstant * (1 - e);
+    f1[i] = vdd[i] * charge / (rd[i] * tDelta) - charges[i];
+    f2[i] = 0;
+    j11[i] = vdd[i] * (tDelta * (1 + e) - 2 * tConstant * (1 - e)) / tDelta;
+    j12[i] = 0;
+    j21[i] = 0;
+    j22[i] = 1;
+  }
+}
+
+void
+RampVFitBatch::evaluate(const std::vector<double>& x1, const std::vector<double>& x2,
+                        double delayMatch)
+{
+  size_t n = size();
+  if (_isDriverFit) {
+    evaluateDriverFit(n, x1.data(), x2.data(), _t50.data(), _t20.data(), _tConstant.data(), 
+                      delayMatch, _f1.data(), _f2.data(), _j11.data(), _j12.data(), 
+                      _j21.data(), _j22.data());
+  } else {
+    evaluateEffCapFit(n, x1.data(), _tDelta.data(), _rd.data(), _vdd.data(), _charge.data(), 
+                      _f1.data(), _f2.data(), _j11.data(), _j12.data(), 
+                      _j21.data(), _j22.data());
+  }
+}
+
+void
+RampVFitBatch::solve(double delayMatch)
+{
+  static const size_t maxDamping = 5;
+  size_t n = size();
+  _f1.resize(n);
+  _f2.resize(n);
+  _j11.resize(n);
+  _j12.resize(n);
+  _j21.resize(n);
+  _j22.resize(n);
+  _isConverged.assign(n, 0);
+  std::vector<unsigned char> active(n, 1);
+  std::vector<unsigned char> accepted(n);
+  std::vector<double> d1(n);
+  std::vector<double> d2(n);
+  std::vector<double> norm(n);
+  std::vector<double> newX1(n);
+  std::vector<double> newX2(n);
+  evaluate(_x1, _x2, delayMatch);
+  _iterCount = 0;
+  size_t numActive = n;
+  while (numActive > 0 && _iterCount < _maxIter) {
+    ++_iterCount;
+    /// Closed form 2x2 Newton step, lanes that are done do not move.
+    /// Convergence is tested on the undamped step, converged lanes take it as is.
+    for (size_t i=0; i<n; ++i) {
+      double det = _j11[i] * _j22[i] - _j12[i] * _j21[i];
+      d1[i] = active[i] ? (_j22[i] * _f1[i] - _j12[i] * _f2[i]) / det : 0;
+      d2[i] = active[i] ? (_j11[i] * _f2[i] - _j21[i] * _f1[i]) / det : 0;
+      norm[i] = _f1[i] * _f1[i] + _f2[i] * _f2[i];
+      bool converged = std::abs(d1[i]) <= std::abs(_x1[i] - d1[i]) * _xTol && 
+                       std::abs(d2[i]) <= std::abs(_x2[i] - d2[i]) * _xTol;
+      _isConverged[i] = _isConverged[i] || (active[i] && converged);
+      accepted[i] = (active[i] == 0) || converged;
+    }
+    /// Steps that do not reduce the residual are halved, lane by lane.
+    /// Lanes whose step is not accepted after maxDamping halvings fail
+    /// and keep their last accepted point. Residuals and Jacobian of the
+    /// lanes still iterating are left at their new points.
+    for (size_t k=0; k<=maxDamping; ++k) {
+      for (size_t i=0; i<n; ++i) {
+        newX1[i] = _x1[i] - d1[i];
+        newX2[i] = _x2[i] - d2[i];
+      }
+      evaluate(newX1, newX2, delayMatch);
+      size_t numRejected = 0;
+      for (size_t i=0; i<n; ++i) {
+        double newNorm = _f1[i] * _f1[i] + _f2[i] * _f2[i];
+        accepted[i] = accepted[i] || (newNorm < norm[i]);
+        double scale = (accepted[i] || k == maxDamping) ? 1 : 0.5;
+        d1[i] *= scale;
+        d2[i] *= scale;
+        numRejected += (accepted[i] == 0);
+      }
+      if (numRejected == 0) {
+        break;
+      }
+    }
+    numActive = 0;
+    for (size_t i=0; i<n; ++i) {
+      bool isFailed = (accepted[i] == 0);
+      _x1[i] = isFailed ? _x1[i] : newX1[i];
+      _x2[i] = isFailed ? _x2[i] : newX2[i];
+      active[i] = active[i] && (_isConverged[i] == 0) && (isFailed == false);
+      numActive += active[i];
+    }
+  }
+}
+
+}
@@ -0,0 +1,72 @@
+#ifndef _NA_RAMPV_BATCH_H_
+#define _NA_RAMPV_BATCH_H_
+
+#include <vector>
+#include <cstddef>
+
+namespace NA {
+
+/// Solves the ramp driver fits of many arcs together.
+/// Each arc is one lane of the arrays below. Newton iterations run over all
+/// lanes with a mask of the lanes that are not converged or failed yet, and the loops
+/// are kept free of branches so that they are vectorized by the compiler.
+/// The equations are the same as the ones of RampVCellDelay::calcIteration.
+class RampVFitBatch {
+  public:
+    RampVFitBatch() = default;
+
+    /// Fit of tZero and tDelta, so that the ramp driver output crosses 
+    /// 50% at t50 and delayMatch at t20. Driver fits and effective cap fits
+    /// can not be mixed in one batch.
+    size_t addDriverFit(double t50, double t20, double rd, double effCap, 
+                        double tZero, double tDelta);
+    /// Effective cap that takes the same charge from the ramp driver
+    size_t addEffCapFit(double tDelta, double rd, double vdd, 
+                        double charge, double effCap);
+
+    void solve(double delayMatch);
+
+    size_t size() const { return _x1.size(); }
+    double tZero(size_t lane) const { return _x1[lane]; }
+    double tDelta(size_t lane) const { return _x2[lane]; }
+    double effCap(size_t lane) const { return _x1[lane]; }
+    size_t iterCount() const { return _iterCount; }
+    /// The Newton step of the lane converged. Lanes fail if damping does not
+    /// reduce their residual or the iteration limit is reached.
+    bool isConverged(size_t lane) const { return _isConverged[lane] != 0; }
+
+  private:
+    void evaluate(const std::vector<double>& x1, const std::vector<double>& x2, 
+                  double delayMatch);
+
+  private:
+    bool                       _isDriverFit = true;
+    /// Constants of driver fit lanes
+    std::vector<double>        _t50;
+    std::vector<double>        _t20;
+    /// rd * effCap
+    std::vector<double>        _tConstant;
+    /// Constants of effective cap fit lanes
+    std::vector<double>        _tDelta;
+    std::vector<double>        _rd;
+    std::vector<double>        _vdd;
+    std::vector<double>        _charge;
+    /// Unknowns, tZero and tDelta, or effCap
+    std::vector<double>        _x1;
+    std::vector<double>        _x2;
+    /// Residuals and Jacobian at the last evaluated point
+    std::vector<double>        _f1;
+    std::vector<double>        _f2;
+    std::vector<double>        _j11;
+    std::vector<double>        _j12;
+    std::vector<double>        _j21;
+    std::vector<double>        _j22;
+    std::vector<unsigned char> _isConverged;
+    double                     _xTol = 0.01;
+    size_t                     _maxIter = 20;
+    size_t                     _iterCount = 0;
+};
+
+}
+
+#endif
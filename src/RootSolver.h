@@ -1,44 +1,154 @@
-#ifndef _NA_RTSVR_H_
-#define _NA_RTSVR_H_
-
-#include <vector>
-#include <functional>
-#include <Eigen/Core>
-#include <Eigen/Dense>
-
-namespace NA {
-
-class RootSolver {
-  public:
-    typedef std::function<double(const Eigen::VectorXd& x)> Function;
-
-    RootSolver() = default;
-    
-    void addFunction(const Function& func);
-    void addDerivativeFunction(const Function& devFunc);
-
-    void setInitX(const std::vector<double>& x);
-    void setXTol(double value) { _xTol = value; }
-    void setMaxIteration(size_t value) { _maxIter = value; }
-
-    bool run();
-    std::vector<double> solution() const;
-    size_t iterCount() const { return _iterCount; }
-
-  private:
-    bool check() const;
-
-  private:
-    std::vector<Function>   _functions;
-    std::vector<Function>   _derivatives;
-    Eigen::VectorXd         _x;
-    double                  _xTol = 0.01;
-    size_t                  _maxIter = 20;
-    size_t                  _iterCount = 0;
-};
-
-}
-
-void testRootSolver();
-
+#ifndef _NA_RTSVR_H_
+#define _NA_RTSVR_H_
+
+#include <vector>
+#include <cmath>
+#include <functional>
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include "Debug.h"
+#include "Trace.h"
+
+namespace NA {
+
+class RootSolver {
+  public:
+    typedef std::function<double(const Eigen::VectorXd& x)> Function;
+
+    RootSolver() = default;
+    
+    void addFunction(const Function& func);
+    void addDerivativeFunction(const Function& devFunc);
+
+    void setInitX(const std::vector<double>& x);
+    void setXTol(double value) { _xTol = value; }
+    void setMaxIteration(size_t value) { _maxIter = value; }
+
+    bool run();
+    std::vector<double> solution() const;
+    size_t iterCount() const { return _iterCount; }
+
+  private:
+    bool check() const;
+
+  private:
+    std::vector<Function>   _functions;
+    std::vector<Function>   _derivatives;
+    Eigen::VectorXd         _x;
+    double                  _xTol = 0.01;
+    size_t                  _maxIter = 20;
+    size_t                  _iterCount = 0;
+};
+
+/// Newton solver of N equations with fixed size Eigen types, no heap allocation.
+/// func(x, f, jac) evaluates residuals f and Jacobian jac at x in one call.
+/// Convergence is tested on the undamped step. Steps that do not reduce the
+/// residual norm are damped by halving, the solver fails if damping does not help.
+template <int N, typename F>
+class FixedRootSolver {
+  public:
+    typedef Eigen::Matrix<double, N, 1> Vector;
+    typedef Eigen::Matrix<double, N, N> Matrix;
+
+    FixedRootSolver(const F& func) : _func(func) {}
+
+    void setInitX(const Vector& x) { _x = x; }
+    void setXTol(double value) { _xTol = value; }
+    void setMaxIteration(size_t value) { _maxIter = value; }
+
+    bool run();
+    const Vector& solution() const { return _x; }
+    size_t iterCount() const { return _iterCount; }
+
+  private:
+    static Vector solveLinear(const Matrix& jac, const Vector& f);
+
+  private:
+    F       _func;
+    Vector  _x = Vector::Zero();
+    double  _xTol = 0.01;
+    size_t  _maxIter = 20;
+    size_t  _iterCount = 0;
+};
+
+template <int N, typename F>
+inline FixedRootSolver<N, F>
+makeFixedRootSolver(const F& func)
+{
+  return FixedRootSolver<N, F>(func);
+}
+
+template <int N, typename F>
+typename FixedRootSolver<N, F>::Vector
+FixedRootSolver<N, F>::solveLinear(const Matrix& jac, const Vector& f)
+{
+  if constexpr (N == 1) {
+    return Vector(f(0) / jac(0, 0));
+  } else if constexpr (N == 2) {
+    double det = jac(0, 0) * jac(1, 1) - jac(0, 1) * jac(1, 0);
+    return Vector((jac(1, 1) * f(0) - jac(0, 1) * f(1)) / det,
+                  (jac(0, 0) * f(1) - jac(1, 0) * f(0)) / det);
+  } else {
+    return jac.partialPivLu().solve(f);
+  }
+}
+
+template <int N, typename F>
+bool
+FixedRootSolver<N, F>::run()
+{
+  static const size_t maxDamping = 5;
+  _iterCount = 0;
+  Vector f;
+  Matrix jac;
+  _func(_x, f, jac);
+  while (_iterCount < _maxIter) {
+    ++_iterCount;
+    Vector d = solveLinear(jac, f);
+    double norm = f.norm();
+    trace<TraceModule::Root>(TraceEvent::NewtonStep, _iterCount, norm, d.norm());
+    bool converged = true;
+    for (Eigen::Index i=0; i<N; ++i) {
+      if (std::abs(d(i)) > std::abs(_x(i) - d(i)) * _xTol) {
+        converged = false;
+        break;
+      }
+    }
+    Vector newX = _x - d;
+    if (converged) {
+      _x = newX;
+      return true;
+    }
+    Vector newF;
+    Matrix newJac;
+    _func(newX, newF, newJac);
+    size_t damping = 0;
+    double newNorm = newF.norm();
+    while (std::isnan(newNorm) || newNorm >= norm) {
+      if (damping == maxDamping) {
+        if (Debug::enabled(DebugModule::Root)) {
+          printf("DEBUG: Newton step rejected, residual norm %G is not reduced\n", norm);
+        }
+        return false;
+      }
+      ++damping;
+      d /= 2;
+      newX = _x - d;
+      _func(newX, newF, newJac);
+      newNorm = newF.norm();
+      if (Debug::enabled(DebugModule::Root)) {
+        printf("DEBUG: Newton step damped, residual norm %G -> %G\n", norm, newNorm);
+      }
+    }
+    _x = newX;
+    f = newF;
+    jac = newJac;
+  }
+  return false;
+}
+
+}
+
+void testRootSolver();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <map>
+#include <numeric>
+#include <algorithm>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "ShardRunner.h"
+#include "Circuit.h"
+#include "CircuitIndex.h"
+#include "Debug.h"
+
+namespace NA {
+
+/// Starts the tag lines of worker outputs, not printed by calculations
+static const char shardTag = '\x1e';
+static const size_t maxShardAttempts = 3;
+static size_t currentSection = 0;
+
+struct ShardWorker {
+  size_t      _attempts = 0;
+  pid_t       _pid = -1;
+  int         _fd = -1;
+  bool        _failed = false;
+  std::string _output;
+};
+
+static bool
+startWorker(const DelayOptions& options, size_t shardIndex,
+            const ShardRunner::WorkFunc& work, ShardWorker& worker)
+{
+  ++worker._attempts;
+  worker._failed = true;
+  int fds[2];
+  if (pipe(fds) != 0) {
+    printf("ERROR: Cannot create pipe for shard %lu\n", shardIndex);
+    return false;
+  }
+  /// Buffered output of the coordinator would be printed again by the worker
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    printf("ERROR: Cannot start worker process for shard %lu\n", shardIndex);
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[1]);
+    DelayOptions shardOptions = options;
+    shardOptions._shardIndex = shardIndex;
+    shardOptions._shardCount = options._workers;
+    shardOptions._isShardWorker = true;
+    work(shardOptions);
+    fflush(stdout);
+    _exit(0);
+  }
+  close(fds[1]);
+  worker._pid = pid;
+  worker._fd = fds[0];
+  worker._failed = false;
+  worker._output.clear();
+  if (Debug::enabled(DebugModule::Sim)) {
+    printf("DEBUG: Shard %lu started in process %d, attempt %lu\n", shardIndex, pid, worker._attempts);
+  }
+  return true;
+}
+
+/// Reads outputs of all running workers until they exit
+static void
+collectWorkers(std::vector<ShardWorker>& workers)
+{
+  char buffer[65536];
+  while (true) {
+    std::vector<pollfd> pollFds;
+    std::vector<size_t> pollWorkers;
+    for (size_t i=0; i<workers.size(); ++i) {
+      if (workers[i]._fd >= 0) {
+        pollFds.push_back({workers[i]._fd, POLLIN, 0});
+        pollWorkers.push_back(i);
+      }
+    }
+    if (pollFds.empty()) {
+      break;
+    }
+    if (poll(pollFds.data(), pollFds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("ERROR: Failed to read outputs of worker processes\n");
+      break;
+    }
+    for (size_t k=0; k<pollFds.size(); ++k) {
+      if (pollFds[k].revents == 0) {
+        continue;
+      }
+      ShardWorker& worker = workers[pollWorkers[k]];
+      ssize_t size = read(worker._fd, buffer, sizeof(buffer));
+      if (size > 0) {
+        worker._output.append(buffer, size);
+      } else if (size == 0 || errno != EINTR) {
+        close(worker._fd);
+        worker._fd = -1;
+      }
+    }
+  }
+  for (ShardWorker& worker : workers) {
+    if (worker._fd >= 0) {
+      close(worker._fd);
+      worker._fd = -1;
+    }
+    if (worker._pid < 0) {
+      continue;
+    }
+    int status = 0;
+    while (waitpid(worker._pid, &status, 0) < 0 && errno == EINTR) {}
+    worker._failed = (WIFEXITED(status) == false || WEXITSTATUS(status) != 0);
+    worker._pid = -1;
+  }
+}
+
+typedef std::pair<size_t, size_t> ArcKey;
+
+/// Splits a worker output into the outputs of each arc
+static void
+splitOutput(const std::string& output, std::map<ArcKey, std::string>& arcOutputs)
+{
+  ArcKey key(0, 0);
+  size_t pos = 0;
+  while (pos < output.size()) {
+    size_t end = output.find('\n', pos);
+    end = (end == std::string::npos) ? output.size() : end + 1;
+    if (output[pos] == shardTag) {
+      unsigned long section = 0;
+      unsigned long arcIndex = 0;
+      if (sscanf(output.data() + pos + 1, "%lu %lu", &section, &arcIndex) == 2) {
+        key = ArcKey(section, arcIndex);
+      }
+    } else {
+      arcOutputs[key].append(output, pos, end - pos);
+    }
+    pos = end;
+  }
+}
+
+bool
+ShardRunner::run(const DelayOptions& options, const WorkFunc& work)
+{
+  std::vector<ShardWorker> workers(options._workers);
+  for (size_t i=0; i<workers.size(); ++i) {
+    startWorker(options, i, work, workers[i]);
+  }
+  bool success = true;
+  while (true) {
+    collectWorkers(workers);
+    bool restarted = false;
+    for (size_t i=0; i<workers.size(); ++i) {
+      ShardWorker& worker = workers[i];
+      if (worker._failed == false) {
+        continue;
+      }
+      if (worker._attempts < maxShardAttempts) {
+        printf("WARNING: Shard %lu failed, running it again\n", i);
+        restarted = startWorker(options, i, work, worker) || restarted;
+      }
+    }
+    if (restarted == false) {
+      break;
+    }
+  }
+  std::map<ArcKey, std::string> arcOutputs;
+  for (size_t i=0; i<workers.size(); ++i) {
+    if (workers[i]._failed) {
+      printf("ERROR: Shard %lu failed after %lu attempts\n", i, workers[i]._attempts);
+      success = false;
+      continue;
+    }
+    splitOutput(workers[i]._output, arcOutputs);
+  }
+  for (const auto& kv : arcOutputs) {
+    fwrite(kv.second.data(), 1, kv.second.size(), stdout);
+  }
+  fflush(stdout);
+  return success;
+}
+
+std::vector<size_t>
+ShardRunner::partition(const std::vector<size_t>& weights, size_t shardCount)
+{
+  std::vector<size_t> order(weights.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&weights](size_t a, size_t b) {
+    return weights[a] > weights[b];
+  });
+  std::vector<size_t> shardWeights(shardCount, 0);
+  std::vector<size_t> shards(weights.size(), 0);
+  for (size_t i : order) {
+    size_t shard = std::min_element(shardWeights.begin(), shardWeights.end()) - shardWeights.begin();
+    shards[i] = shard;
+    shardWeights[shard] += std::max(weights[i], static_cast<size_t>(1));
+  }
+  return shards;
+}
+
+std::vector<bool>
+ShardRunner::shardMask(const Circuit* ckt, const std::vector<const CellArc*>& arcs,
+                       const DelayOptions& options)
+{
+  if (options._shardCount <= 1) {
+    return std::vector<bool>(arcs.size(), true);
+  }
+  std::vector<size_t> weights;
+  for (const CellArc* arc : arcs) {
+    weights.push_back(CircuitIndex::tracedDevices(ckt, arc->driverSourceId()).size());
+  }
+  const std::vector<size_t>& shards = partition(weights, options._shardCount);
+  std::vector<bool> mask(arcs.size(), false);
+  for (size_t i=0; i<arcs.size(); ++i) {
+    mask[i] = (shards[i] == options._shardIndex);
+  }
+  return mask;
+}
+
+void
+ShardRunner::beginSection(const DelayOptions& options)
+{
+  if (options._isShardWorker) {
+    ++currentSection;
+  }
+}
+
+void
+ShardRunner::beginArc(const DelayOptions& options, size_t arcIndex)
+{
+  if (options._isShardWorker) {
+    printf("%c%lu %lu\n", shardTag, currentSection, arcIndex);
+  }
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef _NA_SHARDRUN_H_
+#define _NA_SHARDRUN_H_
+
+#include <vector>
+#include <functional>
+#include "Base.h"
+#include "DelayOptions.h"
+
+namespace NA {
+
+class Circuit;
+class CellArc;
+
+/// Runs the calculations of one deck in worker processes on this host.
+/// The deck is parsed once before the workers are forked, so the parsed
+/// netlist and libraries are shared by all workers copy on write.
+/// Each worker calculates one shard of the driver arcs of every calculation,
+/// and tags the output of each arc. The coordinator collects the outputs
+/// through pipes, runs failed shards again, and prints the outputs in arc order,
+/// the same as a run without workers.
+class ShardRunner {
+  public:
+    typedef std::function<void(const DelayOptions&)> WorkFunc;
+
+    /// Returns false if a shard still fails after its retries
+    static bool run(const DelayOptions& options, const WorkFunc& work);
+
+    /// Shard of each item, items are assigned from the heaviest one
+    /// to the shard with the least total weight
+    static std::vector<size_t> partition(const std::vector<size_t>& weights, size_t shardCount);
+    /// Arcs calculated by this process, arcs are weighted by the size of their nets
+    static std::vector<bool> shardMask(const Circuit* ckt, const std::vector<const CellArc*>& arcs,
+                                       const DelayOptions& options);
+
+    /// Called by each calculation before its arcs
+    static void beginSection(const DelayOptions& options);
+    /// Called before the output of the arc at arcIndex of the current calculation,
+    /// output after the last arc uses arcIndex of the arc count
+    static void beginArc(const DelayOptions& options, size_t arcIndex);
+};
+
+}
+
+#endif
@@ -0,0 +1,206 @@
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include "Trace.h"
+
+namespace NA {
+
+bool Trace::_isActive = false;
+
+static const char traceMagic[8] = {'N', 'A', 'T', 'R', 'A', 'C', 'E', '1'};
+
+struct TraceHeader {
+  char     _magic[8];
+  uint32_t _recordSize;
+  uint32_t _eventCount;
+  uint64_t _recordCount;
+  uint64_t _droppedCount;
+};
+
+/// Written by one thread only
+struct TraceBuffer {
+  std::vector<TraceRecord> _records;
+  uint64_t                 _written = 0;
+  uint32_t                 _thread = 0;
+};
+
+struct TraceState {
+  std::mutex                                _mutex;
+  std::vector<std::unique_ptr<TraceBuffer>> _buffers;
+  std::string                               _fileName;
+  size_t                                    _capacity = 0;
+  /// Buffers of threads that recorded before the trace is restarted are not reused
+  uint64_t                                  _generation = 0;
+  std::chrono::steady_clock::time_point     _startTime;
+};
+
+static TraceState&
+traceState()
+{
+  static TraceState state;
+  return state;
+}
+
+static TraceBuffer*
+newBuffer()
+{
+  TraceState& state = traceState();
+  std::lock_guard<std::mutex> lock(state._mutex);
+  state._buffers.emplace_back(new TraceBuffer());
+  TraceBuffer* buffer = state._buffers.back().get();
+  buffer->_records.resize(state._capacity);
+  buffer->_thread = state._buffers.size() - 1;
+  return buffer;
+}
+
+void
+Trace::start(const std::string& fileName, size_t capacity)
+{
+  TraceState& state = traceState();
+  std::lock_guard<std::mutex> lock(state._mutex);
+  state._buffers.clear();
+  state._fileName = fileName;
+  state._capacity = std::max(capacity, static_cast<size_t>(1));
+  ++state._generation;
+  state._startTime = std::chrono::steady_clock::now();
+  _isActive = true;
+}
+
+void
+Trace::record(TraceEvent event, uint64_t arg, double v0, double v1, double v2)
+{
+  static thread_local TraceBuffer* buffer = nullptr;
+  static thread_local uint64_t generation = 0;
+  TraceState& state = traceState();
+  if (buffer == nullptr || generation != state._generation) {
+    buffer = newBuffer();
+    generation = state._generation;
+  }
+  TraceRecord& rec = buffer->_records[buffer->_written % buffer->_records.size()];
+  rec._time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - state._startTime).count();
+  rec._event = static_cast<uint32_t>(event);
+  rec._thread = buffer->_thread;
+  rec._arg = arg;
+  rec._values[0] = v0;
+  rec._values[1] = v1;
+  rec._values[2] = v2;
+  ++buffer->_written;
+}
+
+void
+Trace::stop()
+{
+  if (_isActive == false) {
+    return;
+  }
+  _isActive = false;
+  TraceState& state = traceState();
+  std::lock_guard<std::mutex> lock(state._mutex);
+  FILE* file = fopen(state._fileName.data(), "wb");
+  if (file == nullptr) {
+    printf("ERROR: Cannot open trace file %s\n", state._fileName.data());
+    return;
+  }
+  TraceHeader header;
+  memcpy(header._magic, traceMagic, sizeof(traceMagic));
+  header._recordSize = sizeof(TraceRecord);
+  header._eventCount = static_cast<uint32_t>(TraceEvent::Count);
+  header._recordCount = 0;
+  header._droppedCount = 0;
+  for (const auto& buffer : state._buffers) {
+    uint64_t size = buffer->_records.size();
+    header._recordCount += std::min(buffer->_written, size);
+    header._droppedCount += buffer->_written > size ? buffer->_written - size : 0;
+  }
+  fwrite(&header, sizeof(header), 1, file);
+  /// Records of each buffer from the oldest one
+  for (const auto& buffer : state._buffers) {
+    uint64_t size = buffer->_records.size();
+    uint64_t first = buffer->_written > size ? buffer->_written - size : 0;
+    for (uint64_t i=first; i<buffer->_written; ++i) {
+      fwrite(&(buffer->_records[i % size]), sizeof(TraceRecord), 1, file);
+    }
+  }
+  fclose(file);
+  state._buffers.clear();
+}
+
+struct TraceEventInfo {
+  const char* _name;
+  const char* _module;
+  const char* _argName;
+  const char* _valueNames[3];
+};
+
+static const TraceEventInfo eventInfos[] = {
+  {"CCSIteration",    "CCS",  "iteration", {"converged", nullptr, nullptr}},
+  {"DriverEffCap",    "CCS",  "region",    {"time", "effCap", nullptr}},
+  {"ReceiverCap",     "CCS",  "device",    {"time", "cap", nullptr}},
+  {"EffCapIteration", "NLDM", "iteration", {"effCap", "charge", nullptr}},
+  {"NewtonStep",      "Root", "iteration", {"residual", "step", nullptr}},
+  {"NetSimulation",   "Sim",  "nodes",     {"endTime", "steps", nullptr}},
+};
+
+static_assert(sizeof(eventInfos) / sizeof(eventInfos[0]) == static_cast<size_t>(TraceEvent::Count),
+              "Every trace event needs an entry in eventInfos");
+
+/// Events are exported as instant events with their values as arguments,
+/// receiver caps are also exported as counters so they are plotted
+bool
+Trace::exportChromeTrace(const char* traceFile, FILE* out)
+{
+  FILE* file = fopen(traceFile, "rb");
+  if (file == nullptr) {
+    printf("ERROR: Cannot open trace file %s\n", traceFile);
+    return false;
+  }
+  TraceHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header._magic, traceMagic, sizeof(traceMagic)) != 0 ||
+      header._recordSize != sizeof(TraceRecord) ||
+      header._eventCount != static_cast<uint32_t>(TraceEvent::Count)) {
+    printf("ERROR: %s is not a trace file of this version\n", traceFile);
+    fclose(file);
+    return false;
+  }
+  std::vector<TraceRecord> records(header._recordCount);
+  size_t readCount = fread(records.data(), sizeof(TraceRecord), records.size(), file);
+  fclose(file);
+  records.resize(readCount);
+  std::stable_sort(records.begin(), records.end(), [](const TraceRecord& a, const TraceRecord& b) {
+    return a._time < b._time;
+  });
+
+  fprintf(out, "{\"otherData\": {\"droppedEvents\": %lu},\n\"traceEvents\": [\n", header._droppedCount);
+  bool isFirst = true;
+  for (const TraceRecord& rec : records) {
+    if (rec._event >= static_cast<uint32_t>(TraceEvent::Count)) {
+      continue;
+    }
+    const TraceEventInfo& info = eventInfos[rec._event];
+    double ts = rec._time / 1000.0;
+    fprintf(out, "%s{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"i\", \"s\": \"t\", "
+                 "\"ts\": %.3f, \"pid\": 0, \"tid\": %u, \"args\": {\"%s\": %lu",
+            isFirst ? "" : ",\n", info._name, info._module, ts, rec._thread, info._argName, rec._arg);
+    for (size_t i=0; i<3; ++i) {
+      if (info._valueNames[i] != nullptr) {
+        fprintf(out, ", \"%s\": %.9g", info._valueNames[i], rec._values[i]);
+      }
+    }
+    fprintf(out, "}}");
+    if (rec._event == static_cast<uint32_t>(TraceEvent::ReceiverCap)) {
+      fprintf(out, ",\n{\"name\": \"cap %lu\", \"cat\": \"%s\", \"ph\": \"C\", \"ts\": %.3f, "
+                   "\"pid\": 0, \"tid\": %u, \"args\": {\"cap\": %.9g}}",
+              rec._arg, info._module, ts, rec._thread, rec._values[1]);
+    }
+    isFirst = false;
+  }
+  fprintf(out, "\n]}\n");
+  return true;
+}
+
+}
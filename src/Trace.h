@@ -0,0 +1,81 @@
+#ifndef _NA_TRACE_H_
+#define _NA_TRACE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "Base.h"
+
+/// Mask of TraceModule compiled in, events of the other modules are removed
+/// at compile time. Set with make TRACE_MODULES=mask.
+#ifndef NA_TRACE_MODULES
+#define NA_TRACE_MODULES 0xff
+#endif
+
+namespace NA {
+
+enum class TraceModule : uint32_t {
+  CCS  = 1,
+  NLDM = 2,
+  Sim  = 4,
+  Root = 8
+};
+
+/// Meaning of the argument and values of each event
+enum class TraceEvent : uint32_t {
+  /// arg: iteration, values: converged
+  CCSIteration,
+  /// arg: voltage region, values: region end time, effective cap
+  DriverEffCap,
+  /// arg: cap device id, values: simulation time, cap value
+  ReceiverCap,
+  /// arg: iteration, values: effective cap, total charge
+  EffCapIteration,
+  /// arg: iteration, values: residual norm before the step, step norm
+  NewtonStep,
+  /// arg: net size, values: end time, step count
+  NetSimulation,
+  Count
+};
+
+struct TraceRecord {
+  /// Nanoseconds since the trace is started
+  uint64_t _time;
+  uint32_t _event;
+  uint32_t _thread;
+  uint64_t _arg;
+  double   _values[3];
+};
+
+/// Binary trace of structured events, written to per-thread ring buffers
+/// without locks or formatting, and saved when the trace is stopped.
+/// When a ring buffer is full the oldest events are overwritten.
+/// Saved traces are converted to the Chrome trace JSON format offline.
+class Trace {
+  public:
+    static void start(const std::string& fileName, size_t capacity = 1 << 16);
+    /// Saves all buffers to the trace file
+    static void stop();
+    static bool isActive() { return _isActive; }
+    static void record(TraceEvent event, uint64_t arg, double v0, double v1, double v2);
+
+    static bool exportChromeTrace(const char* traceFile, FILE* out);
+
+  private:
+    static bool _isActive;
+};
+
+template <TraceModule M>
+inline void
+trace(TraceEvent event, uint64_t arg, double v0 = 0, double v1 = 0, double v2 = 0)
+{
+  if constexpr ((NA_TRACE_MODULES & static_cast<uint32_t>(M)) != 0) {
+    if (Trace::isActive()) {
+      Trace::record(event, arg, v0, v1, v2);
+    }
+  }
+}
+
+}
+
+#endif
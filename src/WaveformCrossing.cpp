@@ -0,0 +1,81 @@
+#include <algorithm>
+#include "WaveformCrossing.h"
+#include "SimResult.h"
+
+namespace NA {
+
+CrossingDetector::CrossingDetector(const std::vector<double>& thresholds)
+: _thresholds(thresholds), 
+  _times(thresholds.size(), 1e99),
+  _pending(thresholds.size())
+{
+  updateRange();
+}
+
+void
+CrossingDetector::updateRange()
+{
+  _minPending = 1e99;
+  _maxPending = -1e99;
+  for (size_t i=0; i<_thresholds.size(); ++i) {
+    if (_times[i] == 1e99) {
+      _minPending = std::min(_minPending, _thresholds[i]);
+      _maxPending = std::max(_maxPending, _thresholds[i]);
+    }
+  }
+}
+
+bool
+CrossingDetector::addPoint(double time, double value)
+{
+  if (_hasPoint == false) {
+    _hasPoint = true;
+    _prevTime = time;
+    _prevValue = value;
+    return false;
+  }
+  double prevTime = _prevTime;
+  double prevValue = _prevValue;
+  _prevTime = time;
+  _prevValue = value;
+  /// Most segments do not reach any pending threshold,
+  /// they are skipped with one range check
+  double low = std::min(prevValue, value);
+  double high = std::max(prevValue, value);
+  if (_pending == 0 || high < _minPending || low > _maxPending || value == prevValue) {
+    return false;
+  }
+  bool crossed = false;
+  for (size_t i=0; i<_thresholds.size(); ++i) {
+    if (_times[i] != 1e99) {
+      continue;
+    }
+    double a = prevValue - _thresholds[i];
+    double b = value - _thresholds[i];
+    if ((a <= 0 && b > 0) || (a >= 0 && b < 0)) {
+      _times[i] = prevTime + (time - prevTime) * (-a) / (b - a);
+      --_pending;
+      crossed = true;
+    }
+  }
+  if (crossed) {
+    updateRange();
+  }
+  return crossed;
+}
+
+void 
+measureCrossings(const Waveform& waveform, const std::vector<double>& thresholds,
+                 std::vector<double>& times)
+{
+  CrossingDetector detector(thresholds);
+  for (const auto& point : waveform.data()) {
+    detector.addPoint(point._time, point._value);
+    if (detector.allCrossed()) {
+      break;
+    }
+  }
+  times = detector.crossingTimes();
+}
+
+}
@@ -0,0 +1,51 @@
+#ifndef _NA_WFCROSS_H_
+#define _NA_WFCROSS_H_
+
+#include <vector>
+#include "Base.h"
+
+namespace NA {
+
+class Waveform;
+
+/// Finds the first crossing of several threshold voltages in one pass.
+/// Samples are fed in time order, either while the waveform is simulated
+/// or from a finished waveform. Crossing times are linearly interpolated,
+/// thresholds that are never crossed are reported as 1e99, the same as
+/// Waveform::measure.
+class CrossingDetector {
+  public:
+    CrossingDetector() = default;
+    CrossingDetector(const std::vector<double>& thresholds);
+
+    /// Returns true if any threshold is crossed by the new point
+    bool addPoint(double time, double value);
+
+    const std::vector<double>& thresholds() const { return _thresholds; }
+    const std::vector<double>& crossingTimes() const { return _times; }
+    double crossingTime(size_t index) const { return _times[index]; }
+    bool isCrossed(size_t index) const { return _times[index] != 1e99; }
+    bool allCrossed() const { return _pending == 0; }
+
+  private:
+    void updateRange();
+
+  private:
+    std::vector<double> _thresholds;
+    std::vector<double> _times;
+    size_t              _pending = 0;
+    /// Range of the thresholds not crossed yet
+    double              _minPending = 0;
+    double              _maxPending = 0;
+    bool                _hasPoint = false;
+    double              _prevTime = 0;
+    double              _prevValue = 0;
+};
+
+/// Crossing times of all thresholds on waveform in one scan
+void measureCrossings(const Waveform& waveform, const std::vector<double>& thresholds,
+                      std::vector<double>& times);
+
+}
+
+#endif
@@ -0,0 +1,182 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "RampVFitBatch.h"
+#include "RootSolver.h"
+
+/// Times the ramp driver fit of RampVFitBatch against the per arc
+/// FixedRootSolver of RampVCellDelay::calcIteration on the same random
+/// lanes, and checks that both give the same fits. The scalar fit is timed
+/// with the equations of RampVCellDelay, and with the arithmetic of the
+/// batch lanes, which leaves only the vectorization as the difference.
+/// Usage: fit_bench [lanes] [repeat]
+
+using namespace NA;
+
+static const double delayMatch = 0.2;
+
+struct FitLane {
+  double _t50;
+  double _t20;
+  double _tConstant;
+  double _tDelta;
+};
+
+/// y, dydtz and dydtD of RampVCellDelay, which evaluate y0 and its
+/// exponential separately for each of them
+static inline double
+y0(double t, double tZero, double tConstant)
+{
+  double tShift = t - tZero;
+  return tShift - tConstant * (1 - std::exp(-tShift / tConstant));
+}
+
+static void
+cellRampPoint(double t, double tZero, double tDelta, double tConstant,
+              double& y, double& dydtz, double& dydtD)
+{
+  double tShift = t - tZero;
+  if (tShift <= 0) {
+    y = 0;
+    dydtz = 0;
+    dydtD = 0;
+  } else if (tShift < tDelta) {
+    y = y0(t, tZero, tConstant) / tDelta;
+    dydtz = (std::exp(-tShift / tConstant) - 1) / tDelta;
+    dydtD = -y0(t, tZero, tConstant) / (tDelta * tDelta);
+  } else {
+    double tmtD = t - tDelta;
+    y = (y0(t, tZero, tConstant) - y0(tmtD, tZero, tConstant)) / tDelta;
+    dydtz = std::exp(-tShift / tConstant) - std::exp(-(tmtD - tZero) / tConstant);
+    dydtD = -y0(t, tZero, tConstant) / (tDelta * tDelta) - 
+            y0(tmtD, tZero, tConstant) / (tmtD * tmtD);
+  }
+}
+
+/// The arithmetic of the batch lanes, one lane at a time with std::exp,
+/// so the difference to the batch is the vectorization
+static void
+sharedRampPoint(double t, double tZero, double tDelta, double tConstant,
+                double& y, double& dydtz, double& dydtD)
+{
+  double tShift = t - tZero;
+  double s1 = std::max(tShift, 0.0);
+  double s2 = std::max(tShift - tDelta, 0.0);
+  double e1 = std::exp(-s1 / tConstant);
+  double e2 = std::exp(-s2 / tConstant);
+  double y0a = s1 - tConstant * (1 - e1);
+  double y0b = s2 - tConstant * (1 - e2);
+  double tmtD = t - tDelta;
+  y = (y0a - y0b) / tDelta;
+  if (tShift < tDelta) {
+    dydtz = (e1 - 1) / tDelta;
+    dydtD = -y0a / (tDelta * tDelta);
+  } else {
+    dydtz = e1 - e2;
+    dydtD = -y0a / (tDelta * tDelta) - y0b / (tmtD * tmtD);
+  }
+}
+
+typedef void (*RampPointFunc)(double, double, double, double, double&, double&, double&);
+
+static std::vector<FitLane>
+makeLanes(size_t numLanes)
+{
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> dist(0, 1);
+  std::vector<FitLane> lanes(numLanes);
+  for (FitLane& lane : lanes) {
+    lane._tConstant = (0.5 + dist(gen)) * 20e-12;
+    double tDelta = (0.5 + dist(gen)) * 100e-12;
+    lane._t50 = 0.5 * tDelta + lane._tConstant * (0.7 + 0.3 * dist(gen));
+    lane._t20 = 0.2 * tDelta + lane._tConstant * 0.3;
+    lane._tDelta = tDelta * 1.2;
+  }
+  return lanes;
+}
+
+static double
+elapsedNs(std::chrono::steady_clock::time_point start)
+{
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/// Best time of repeat runs of FixedRootSolver on every lane
+static double
+timeScalar(const std::vector<FitLane>& lanes, size_t repeat, RampPointFunc rampPoint, 
+           std::vector<Eigen::Vector2d>& sol, std::vector<unsigned char>& isConverged)
+{
+  double bestNs = 1e30;
+  for (size_t r=0; r<repeat; ++r) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i=0; i<lanes.size(); ++i) {
+      const FitLane& lane = lanes[i];
+      auto tFunc = [&lane, rampPoint](const Eigen::Vector2d& x, Eigen::Vector2d& f, 
+                                      Eigen::Matrix2d& jac) {
+        double y1, y2;
+        rampPoint(lane._t50, x(0), x(1), lane._tConstant, y1, jac(0, 0), jac(0, 1));
+        rampPoint(lane._t20, x(0), x(1), lane._tConstant, y2, jac(1, 0), jac(1, 1));
+        f(0) = y1 - 0.5;
+        f(1) = y2 - delayMatch;
+      };
+      auto tSolver = makeFixedRootSolver<2>(tFunc);
+      tSolver.setInitX(Eigen::Vector2d(0, lane._tDelta));
+      isConverged[i] = tSolver.run();
+      sol[i] = tSolver.solution();
+    }
+    bestNs = std::min(bestNs, elapsedNs(start));
+  }
+  return bestNs;
+}
+
+int
+main(int argc, char** argv)
+{
+  size_t numLanes = (argc > 1) ? std::atoi(argv[1]) : 4096;
+  size_t repeat = (argc > 2) ? std::atoi(argv[2]) : 20;
+  std::vector<FitLane> lanes = makeLanes(numLanes);
+
+  double batchNs = 1e30;
+  RampVFitBatch batch;
+  for (size_t r=0; r<repeat; ++r) {
+    RampVFitBatch newBatch;
+    auto start = std::chrono::steady_clock::now();
+    for (const FitLane& lane : lanes) {
+      newBatch.addDriverFit(lane._t50, lane._t20, lane._tConstant, 1, 0, lane._tDelta);
+    }
+    newBatch.solve(delayMatch);
+    batchNs = std::min(batchNs, elapsedNs(start));
+    batch = newBatch;
+  }
+
+  std::vector<Eigen::Vector2d> scalarSol(numLanes);
+  std::vector<unsigned char> scalarConverged(numLanes);
+  double cellNs = timeScalar(lanes, repeat, cellRampPoint, scalarSol, scalarConverged);
+  double sharedNs = timeScalar(lanes, repeat, sharedRampPoint, scalarSol, scalarConverged);
+
+  size_t numAgree = 0;
+  size_t numConverged = 0;
+  double maxRelDiff = 0;
+  for (size_t i=0; i<numLanes; ++i) {
+    bool isConverged = batch.isConverged(i);
+    numConverged += isConverged;
+    numAgree += (isConverged == (scalarConverged[i] != 0));
+    if (isConverged && scalarConverged[i]) {
+      maxRelDiff = std::max(maxRelDiff, std::abs(batch.tZero(i) - scalarSol[i](0)) / scalarSol[i](1));
+      maxRelDiff = std::max(maxRelDiff, std::abs(batch.tDelta(i) - scalarSol[i](1)) / scalarSol[i](1));
+    }
+  }
+  printf("lanes %lu, converged %lu, status agrees on %lu, max relative difference %G\n",
+         numLanes, numConverged, numAgree, maxRelDiff);
+  printf("batch              %8.1f ns/lane\n", batchNs / numLanes);
+  printf("scalar, shared exp %8.1f ns/lane, %.2fx of batch\n", 
+         sharedNs / numLanes, sharedNs / batchNs);
+  printf("scalar, cell delay %8.1f ns/lane, %.2fx of batch\n", 
+         cellNs / numLanes, cellNs / batchNs);
+  return (numAgree == numLanes) ? 0 : 1;
+}
@@ -1,14 +1,116 @@
 #include <cstdio>
+#include <cstring>
+#include <cstdlib>
 #include "DelayCalculator.h"
+#include "DelayOptions.h"
+#include "Trace.h"
+
+static bool
+parseOption(const char* arg, NA::DelayOptions& options)
+{
+  if (strcmp(arg, "-ceff=tran") == 0) {
+    options._effCapMode = NA::EffCapMode::Transient;
+  } else if (strcmp(arg, "-ceff=pimodel") == 0) {
+    options._effCapMode = NA::EffCapMode::PiModel;
+  } else if (strcmp(arg, "-fit=arc") == 0) {
+    options._batchFit = false;
+  } else if (strcmp(arg, "-fit=batch") == 0) {
+    options._batchFit = true;
+  } else if (strncmp(arg, "-refine-above=", 14) == 0) {
+    options._refineThreshold = strtod(arg + 14, nullptr);
+  } else if (strncmp(arg, "-refine-top=", 12) == 0) {
+    options._refineTopK = strtoul(arg + 12, nullptr, 10);
+  } else if (strcmp(arg, "-integrate=be") == 0) {
+    options._integrateMode = NA::IntegrateMode::BackwardEuler;
+  } else if (strcmp(arg, "-integrate=trap") == 0) {
+    options._integrateMode = NA::IntegrateMode::Trapezoidal;
+  } else if (strcmp(arg, "-integrate=gear2") == 0) {
+    options._integrateMode = NA::IntegrateMode::Gear2;
+  } else if (strcmp(arg, "-integrate=trbdf2") == 0) {
+    options._integrateMode = NA::IntegrateMode::TRBDF2;
+  } else if (strncmp(arg, "-step-scale=", 12) == 0) {
+    options._stepFactor = strtod(arg + 12, nullptr);
+    if (options._stepFactor <= 0) {
+      printf("ERROR: Invalid step scale in %s\n", arg);
+      return false;
+    }
+  } else if (strncmp(arg, "-lstable-step-scale=", 20) == 0) {
+    options._lStableStepFactor = strtod(arg + 20, nullptr);
+    if (options._lStableStepFactor <= 0) {
+      printf("ERROR: Invalid step scale in %s\n", arg);
+      return false;
+    }
+  } else if (strcmp(arg, "-compact") == 0) {
+    options._compactWaveforms = true;
+  } else if (strcmp(arg, "-path") == 0) {
+    options._isPathMode = true;
+  } else if (strncmp(arg, "-ccs-tolerance=", 15) == 0) {
+    options._ccsTolerance = strtod(arg + 15, nullptr);
+  } else if (strncmp(arg, "-max-iter=", 10) == 0) {
+    options._maxIterations = strtoul(arg + 10, nullptr, 10);
+  } else if (strncmp(arg, "-arc-time=", 10) == 0) {
+    options._maxArcSeconds = strtod(arg + 10, nullptr);
+  } else if (strcmp(arg, "-report-iter") == 0) {
+    options._reportIterations = true;
+  } else if (strcmp(arg, "-check-lut") == 0) {
+    options._checkLUT = true;
+  } else if (strcmp(arg, "-xtalk") == 0) {
+    options._isCrosstalk = true;
+  } else if (strncmp(arg, "-xtalk-window=", 14) == 0) {
+    options._crosstalkWindow = strtod(arg + 14, nullptr);
+  } else if (strncmp(arg, "-xtalk-align=", 13) == 0) {
+    options._crosstalkAlignments = strtoul(arg + 13, nullptr, 10);
+  } else if (strncmp(arg, "-workers=", 9) == 0) {
+    options._workers = strtoul(arg + 9, nullptr, 10);
+    if (options._workers == 0) {
+      printf("ERROR: Invalid number of workers in %s\n", arg);
+      return false;
+    }
+  } else if (strncmp(arg, "-trace=", 7) == 0) {
+    options._traceFile = arg + 7;
+  } else if (strncmp(arg, "-checkpoint=", 12) == 0) {
+    options._checkpointFile = arg + 12;
+  } else if (strcmp(arg, "-resume") == 0) {
+    options._resume = true;
+  } else if (strncmp(arg, "-shard=", 7) == 0) {
+    unsigned long shardIndex = 0;
+    unsigned long shardCount = 0;
+    if (sscanf(arg + 7, "%lu/%lu", &shardIndex, &shardCount) != 2 || shardIndex >= shardCount) {
+      printf("ERROR: Invalid shard %s, expecting -shard=index/count\n", arg);
+      return false;
+    }
+    options._shardIndex = shardIndex;
+    options._shardCount = shardCount;
+  } else {
+    printf("ERROR: Unknown option %s\n", arg);
+    return false;
+  }
+  return true;
+}
 
 int main(int argc, char** argv) 
 {
-  if (argc < 2) {
+  NA::DelayOptions options;
+  const char* inputFile = nullptr;
+  for (int i=1; i<argc; ++i) {
+    if (strncmp(argv[i], "-trace-export=", 14) == 0) {
+      /// Converts a saved trace to Chrome trace JSON on stdout
+      return NA::Trace::exportChromeTrace(argv[i] + 14, stdout) ? 0 : 1;
+    }
+    if (argv[i][0] == '-') {
+      if (parseOption(argv[i], options) == false) {
+        return 1;
+      }
+    } else {
+      inputFile = argv[i];
+    }
+  }
+  if (inputFile == nullptr) {
     printf("Input file missing, please provide a circuit netlist\n");
     return 1;
   }
 
-  NA::DelayCalculator::run(argv[1]);
+  NA::DelayCalculator::run(inputFile, options);
 
   return 0;
 }